@@ -0,0 +1,294 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#include "AnnotationIndex.h"
+
+// System headers
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+// Upper bound on the number of cells of the grid
+const double MAX_CELLS = 4194304.0;
+
+// Sample points along each side of a partially covered rectangle
+const int COVERAGE_SAMPLES = 8;
+
+double orientation(const AnnotationVertex& a, const AnnotationVertex& b,
+                   const AnnotationVertex& c) {
+	return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+/// Whether a graphic of session type \c type encloses a region; polylines,
+/// point sets and rulers do not
+bool isClosedRegion(const std::string& type) {
+	return "polygon" == type || "rectangle" == type;
+}
+
+/// Value of the attribute \c name in the tag spanning [\c begin, \c end)
+std::string attribute(const std::string& xml, size_t begin, size_t end,
+                      const std::string& name) {
+	auto pos = xml.find(" " + name + "=\"", begin);
+	if (pos == std::string::npos || pos >= end)
+		return std::string();
+	pos += name.size() + 3;
+	auto close = xml.find('"', pos);
+	if (close == std::string::npos || close >= end)
+		return std::string();
+	return xml.substr(pos, close - pos);
+}
+
+void toggle(std::vector<int>& set, int value) {
+	auto it = std::find(set.begin(), set.end(), value);
+	if (it == set.end())
+		set.push_back(value);
+	else
+		set.erase(it);
+}
+
+} // namespace
+
+std::vector<AnnotationPolygon> readSessionPolygons(const std::string& path) {
+	std::ifstream file(path);
+	if (!file)
+		throw std::runtime_error("Unable to open the annotation session: " + path);
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	const std::string xml = buffer.str();
+
+	std::vector<AnnotationPolygon> polygons;
+	size_t pos = 0;
+	while ((pos = xml.find("<graphic", pos)) != std::string::npos) {
+		auto end = xml.find("</graphic>", pos);
+		if (end == std::string::npos)
+			break;
+		if (!isClosedRegion(attribute(xml, pos, xml.find('>', pos), "type")))
+		{
+			pos = end;
+			continue;
+		}
+
+		AnnotationPolygon polygon;
+		auto point = xml.find("<point>", pos);
+		while (point != std::string::npos && point < end) {
+			point += 7;
+			AnnotationVertex vertex;
+			char comma;
+			std::istringstream ss(xml.substr(point, xml.find("</point>", point) - point));
+			if (ss >> vertex.x >> comma >> vertex.y)
+				polygon.push_back(vertex);
+			point = xml.find("<point>", point);
+		}
+		if (polygon.size() >= 3)
+			polygons.push_back(polygon);
+		pos = end;
+	}
+	return polygons;
+}
+
+AnnotationIndex::AnnotationIndex(const std::vector<AnnotationPolygon>& polygons,
+                                 double cell_size)
+    : polygons_(polygons),
+      origin_x_(0.0),
+      origin_y_(0.0),
+      cell_size_(std::max(1.0, cell_size)),
+      columns_(0),
+      rows_(0) {
+	double min_x = HUGE_VAL, min_y = HUGE_VAL, max_x = -HUGE_VAL, max_y = -HUGE_VAL;
+	for (int p = 0; p < (int)polygons_.size(); ++p) {
+		const auto& polygon = polygons_[p];
+		for (size_t i = 0; i < polygon.size(); ++i) {
+			Edge edge = { p, polygon[i], polygon[(i + 1) % polygon.size()] };
+			edges_.push_back(edge);
+			min_x = std::min(min_x, polygon[i].x);
+			min_y = std::min(min_y, polygon[i].y);
+			max_x = std::max(max_x, polygon[i].x);
+			max_y = std::max(max_y, polygon[i].y);
+		}
+	}
+	if (edges_.empty())
+		return;
+
+	// Coarsen the grid if the annotations span too many cells
+	double width = max_x - min_x, height = max_y - min_y;
+	if ((width / cell_size_ + 1) * (height / cell_size_ + 1) > MAX_CELLS)
+		cell_size_ = std::sqrt(width * height / MAX_CELLS) + 1.0;
+
+	origin_x_ = min_x;
+	origin_y_ = min_y;
+	columns_ = (int)(width / cell_size_) + 1;
+	rows_ = (int)(height / cell_size_) + 1;
+	cell_edges_.resize((size_t)columns_ * rows_);
+	cell_polygons_.resize((size_t)columns_ * rows_);
+
+	// Bin each edge into the cells it crosses, and into the rows whose centre
+	// line it spans
+	std::vector<std::vector<int>> row_edges(rows_);
+	for (int e = 0; e < (int)edges_.size(); ++e) {
+		const auto& edge = edges_[e];
+		int c0 = (int)((std::min(edge.a.x, edge.b.x) - origin_x_) / cell_size_);
+		int c1 = (int)((std::max(edge.a.x, edge.b.x) - origin_x_) / cell_size_);
+		int r0 = (int)((std::min(edge.a.y, edge.b.y) - origin_y_) / cell_size_);
+		int r1 = (int)((std::max(edge.a.y, edge.b.y) - origin_y_) / cell_size_);
+		for (int r = r0; r <= std::min(r1, rows_ - 1); ++r) {
+			row_edges[r].push_back(e);
+			for (int c = c0; c <= std::min(c1, columns_ - 1); ++c) {
+				double x = origin_x_ + c * cell_size_, y = origin_y_ + r * cell_size_;
+				if (crosses(edge, x, y, x + cell_size_, y + cell_size_))
+					cell_edges_[(size_t)r * columns_ + c].push_back(e);
+			}
+		}
+	}
+
+	// Scan the centre line of each row to find the polygons containing each
+	// cell centre
+	std::vector<std::vector<double>> crossings(polygons_.size());
+	for (int r = 0; r < rows_; ++r) {
+		double y = origin_y_ + (r + 0.5) * cell_size_;
+		for (auto e : row_edges[r]) {
+			const auto& edge = edges_[e];
+			if ((edge.a.y > y) != (edge.b.y > y)) {
+				double t = (y - edge.a.y) / (edge.b.y - edge.a.y);
+				crossings[edge.polygon].push_back(edge.a.x + t * (edge.b.x - edge.a.x));
+			}
+		}
+		for (int p = 0; p < (int)crossings.size(); ++p) {
+			auto& xs = crossings[p];
+			std::sort(xs.begin(), xs.end());
+			for (size_t i = 0; i + 1 < xs.size(); i += 2) {
+				int c0 = std::max(0, (int)std::ceil((xs[i] - origin_x_) / cell_size_ - 0.5));
+				int c1 = std::min(columns_ - 1, (int)std::ceil((xs[i + 1] - origin_x_) / cell_size_ - 0.5) - 1);
+				for (int c = c0; c <= c1; ++c)
+					cell_polygons_[(size_t)r * columns_ + c].push_back(p);
+			}
+			xs.clear();
+		}
+	}
+}
+
+int AnnotationIndex::cellIndex(double x, double y) const {
+	if (x < origin_x_ || y < origin_y_)
+		return -1;
+	int c = (int)((x - origin_x_) / cell_size_);
+	int r = (int)((y - origin_y_) / cell_size_);
+	if (c >= columns_ || r >= rows_)
+		return -1;
+	return r * columns_ + c;
+}
+
+bool AnnotationIndex::contains(double x, double y) const {
+	int cell = cellIndex(x, y);
+	if (cell < 0)
+		return false;
+
+	// Start from the polygons containing the cell centre, and toggle each
+	// polygon whose boundary lies between the centre and the point
+	AnnotationVertex point = { x, y };
+	AnnotationVertex centre = {
+		origin_x_ + (cell % columns_ + 0.5) * cell_size_,
+		origin_y_ + (cell / columns_ + 0.5) * cell_size_ };
+	auto inside = cell_polygons_[cell];
+	for (auto e : cell_edges_[cell]) {
+		const auto& edge = edges_[e];
+		if ((orientation(centre, point, edge.a) > 0) != (orientation(centre, point, edge.b) > 0) &&
+			(orientation(edge.a, edge.b, centre) > 0) != (orientation(edge.a, edge.b, point) > 0))
+			toggle(inside, edge.polygon);
+	}
+	return !inside.empty();
+}
+
+AnnotationIndex::Classification AnnotationIndex::classify(double x0, double y0,
+                                                          double x1, double y1) const {
+	if (edges_.empty())
+		return OUTSIDE;
+
+	int c0 = std::max(0, (int)std::floor((x0 - origin_x_) / cell_size_));
+	int c1 = std::min(columns_ - 1, (int)std::floor((x1 - origin_x_) / cell_size_));
+	int r0 = std::max(0, (int)std::floor((y0 - origin_y_) / cell_size_));
+	int r1 = std::min(rows_ - 1, (int)std::floor((y1 - origin_y_) / cell_size_));
+	for (int r = r0; r <= r1; ++r) {
+		for (int c = c0; c <= c1; ++c) {
+			for (auto e : cell_edges_[(size_t)r * columns_ + c]) {
+				if (crosses(edges_[e], x0, y0, x1, y1))
+					return PARTIAL;
+			}
+		}
+	}
+
+	// No boundary inside the rectangle, one point decides for all of it
+	return contains((x0 + x1) / 2, (y0 + y1) / 2) ? INSIDE : OUTSIDE;
+}
+
+double AnnotationIndex::coverage(double x0, double y0, double x1, double y1) const {
+	switch (classify(x0, y0, x1, y1)) {
+	case INSIDE:
+		return 1.0;
+	case OUTSIDE:
+		return 0.0;
+	default:
+		break;
+	}
+
+	int covered = 0;
+	double step_x = (x1 - x0) / COVERAGE_SAMPLES, step_y = (y1 - y0) / COVERAGE_SAMPLES;
+	for (int j = 0; j < COVERAGE_SAMPLES; ++j)
+		for (int i = 0; i < COVERAGE_SAMPLES; ++i)
+			covered += contains(x0 + (i + 0.5) * step_x, y0 + (j + 0.5) * step_y);
+	return (double)covered / (COVERAGE_SAMPLES * COVERAGE_SAMPLES);
+}
+
+bool AnnotationIndex::crosses(const Edge& edge, double x0, double y0,
+                              double x1, double y1) {
+	// Liang-Barsky clipping of the edge against the rectangle
+	double dx = edge.b.x - edge.a.x, dy = edge.b.y - edge.a.y;
+	double p[4] = { -dx, dx, -dy, dy };
+	double q[4] = { edge.a.x - x0, x1 - edge.a.x, edge.a.y - y0, y1 - edge.a.y };
+	double t0 = 0.0, t1 = 1.0;
+	for (int i = 0; i < 4; ++i) {
+		if (0.0 == p[i]) {
+			if (q[i] < 0.0)
+				return false;
+		} else {
+			double t = q[i] / p[i];
+			if (p[i] < 0.0)
+				t0 = std::max(t0, t);
+			else
+				t1 = std::min(t1, t);
+			if (t0 > t1)
+				return false;
+		}
+	}
+	return true;
+}
+
+} // namespace algorithm
+} // namespace sedeen
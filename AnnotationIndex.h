@@ -0,0 +1,119 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#ifndef SEDEEN_SRC_TILEEXTRACTION_ANNOTATIONINDEX_H
+#define SEDEEN_SRC_TILEEXTRACTION_ANNOTATIONINDEX_H
+
+// System headers
+#include <string>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+/// A vertex of an annotation polygon, in full resolution pixel coordinates
+struct AnnotationVertex {
+  double x;
+  double y;
+};
+
+typedef std::vector<AnnotationVertex> AnnotationPolygon;
+
+/// Reads the annotation regions of a Sedeen session XML file
+//
+/// Polygons and rectangles with at least three points are returned as closed
+/// polygons; open graphics such as polylines, point sets and rulers are
+/// skipped.
+//
+/// \throws std::runtime_error if the file cannot be read
+std::vector<AnnotationPolygon> readSessionPolygons(const std::string& path);
+
+/// Spatial index answering how much of a rectangle lies inside any polygon
+//
+/// Polygon edges are binned into a uniform grid. For the centre of every cell
+/// the set of polygons containing it is precomputed, so a point query only
+/// has to test the edges of its own cell, and a rectangle that no edge
+/// crosses is classified from a single point. The cost of a query therefore
+/// depends on the local edge density, not on the number of polygons.
+class AnnotationIndex {
+ public:
+  /// Position of a rectangle relative to the annotations
+  enum Classification {
+    OUTSIDE,
+    INSIDE,
+    PARTIAL
+  };
+
+  /// Builds the index with square cells of \a cell_size pixels
+  AnnotationIndex(const std::vector<AnnotationPolygon>& polygons, double cell_size);
+
+  /// Check if the point lies inside any of the polygons
+  bool contains(double x, double y) const;
+
+  /// Classifies the rectangle [x0, x1) x [y0, y1)
+  Classification classify(double x0, double y0, double x1, double y1) const;
+
+  /// Fraction of the rectangle [x0, x1) x [y0, y1) covered by the polygons
+  //
+  /// Exact for rectangles that are entirely inside or outside; rectangles
+  /// crossed by an edge are estimated on a regular grid of sample points.
+  double coverage(double x0, double y0, double x1, double y1) const;
+
+  /// Number of indexed polygons
+  size_t size() const { return polygons_.size(); }
+
+ private:
+  struct Edge {
+    int polygon;
+    AnnotationVertex a;
+    AnnotationVertex b;
+  };
+
+  /// Index of the cell containing the point, or -1 outside of the grid
+  int cellIndex(double x, double y) const;
+
+  /// Check if the edge crosses the rectangle [x0, x1] x [y0, y1]
+  static bool crosses(const Edge& edge, double x0, double y0, double x1, double y1);
+
+  std::vector<AnnotationPolygon> polygons_;
+  std::vector<Edge> edges_;
+
+  double origin_x_;
+  double origin_y_;
+  double cell_size_;
+  int columns_;
+  int rows_;
+
+  /// Edges overlapping each cell
+  std::vector<std::vector<int>> cell_edges_;
+
+  /// Polygons containing the centre of each cell
+  std::vector<std::vector<int>> cell_polygons_;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif
@@ -0,0 +1,197 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#include "ColorStatistics.h"
+
+// System headers
+#include <algorithm>
+#include <cmath>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+// Mean optical density above which a pixel is counted as tissue
+const float TISSUE_OD_THRESHOLD = 0.15f;
+
+// Pixels accumulated in 32-bit sums before being added to the 64-bit totals;
+// 4096 * 255 * 255 still fits in an unsigned 32-bit integer
+const size_t BLOCK_SIZE = 4096;
+
+// Index pairs of the upper triangle of a 3x3 matrix
+const int PAIRS[6][2] = {{0, 0}, {0, 1}, {0, 2}, {1, 1}, {1, 2}, {2, 2}};
+
+/// Optical density of each 8-bit intensity
+struct OpticalDensityTable {
+	float od[256];
+	OpticalDensityTable() {
+		for (int i = 0; i < 256; ++i)
+			od[i] = static_cast<float>(-std::log10((i + 1) / 256.0));
+	}
+};
+
+const OpticalDensityTable OD_TABLE;
+
+void covariance(const double* sum, const double* product, double n, double cov[6]) {
+	for (int k = 0; k < 6; ++k) {
+		auto i = PAIRS[k][0], j = PAIRS[k][1];
+		cov[k] = n > 0 ? product[k] / n - (sum[i] / n) * (sum[j] / n) : 0.0;
+	}
+}
+
+} // namespace
+
+ColorStatistics::ColorStatistics()
+    : count_(0),
+      tissue_count_(0) {
+	std::fill(sum_, sum_ + 3, 0);
+	std::fill(product_, product_ + 6, 0);
+	std::fill(od_sum_, od_sum_ + 3, 0.0);
+	std::fill(od_product_, od_product_ + 6, 0.0);
+}
+
+void ColorStatistics::accumulate(const uint8_t* rgb, size_t count) {
+	const float* od = OD_TABLE.od;
+	for (size_t start = 0; start < count; start += BLOCK_SIZE) {
+		auto end = std::min(count, start + BLOCK_SIZE);
+		auto block = rgb + start * 3;
+		auto n = end - start;
+
+		// Integer sums - branch free so the compiler can vectorise the loop
+		uint32_t r = 0, g = 0, b = 0;
+		uint32_t rr = 0, rg = 0, rb = 0, gg = 0, gb = 0, bb = 0;
+		for (size_t p = 0; p < n; ++p) {
+			uint32_t pr = block[3 * p], pg = block[3 * p + 1], pb = block[3 * p + 2];
+			r += pr; g += pg; b += pb;
+			rr += pr * pr; rg += pr * pg; rb += pr * pb;
+			gg += pg * pg; gb += pg * pb; bb += pb * pb;
+		}
+
+		// Optical density sums, looked up per channel
+		float odr = 0, odg = 0, odb = 0;
+		float odrr = 0, odrg = 0, odrb = 0, odgg = 0, odgb = 0, odbb = 0;
+		uint32_t tissue = 0;
+		for (size_t p = 0; p < n; ++p) {
+			float dr = od[block[3 * p]], dg = od[block[3 * p + 1]], db = od[block[3 * p + 2]];
+			odr += dr; odg += dg; odb += db;
+			odrr += dr * dr; odrg += dr * dg; odrb += dr * db;
+			odgg += dg * dg; odgb += dg * db; odbb += db * db;
+			tissue += (dr + dg + db) > 3.0f * TISSUE_OD_THRESHOLD;
+		}
+
+		count_ += n;
+		tissue_count_ += tissue;
+		sum_[0] += r; sum_[1] += g; sum_[2] += b;
+		product_[0] += rr; product_[1] += rg; product_[2] += rb;
+		product_[3] += gg; product_[4] += gb; product_[5] += bb;
+		od_sum_[0] += odr; od_sum_[1] += odg; od_sum_[2] += odb;
+		od_product_[0] += odrr; od_product_[1] += odrg; od_product_[2] += odrb;
+		od_product_[3] += odgg; od_product_[4] += odgb; od_product_[5] += odbb;
+	}
+}
+
+void ColorStatistics::merge(const ColorStatistics& other) {
+	count_ += other.count_;
+	tissue_count_ += other.tissue_count_;
+	for (int i = 0; i < 3; ++i) {
+		sum_[i] += other.sum_[i];
+		od_sum_[i] += other.od_sum_[i];
+	}
+	for (int i = 0; i < 6; ++i) {
+		product_[i] += other.product_[i];
+		od_product_[i] += other.od_product_[i];
+	}
+}
+
+void ColorStatistics::rgbMean(double mean[3]) const {
+	for (int i = 0; i < 3; ++i)
+		mean[i] = count_ ? static_cast<double>(sum_[i]) / count_ : 0.0;
+}
+
+void ColorStatistics::rgbCovariance(double cov[6]) const {
+	double sum[3], product[6];
+	std::copy(sum_, sum_ + 3, sum);
+	std::copy(product_, product_ + 6, product);
+	covariance(sum, product, static_cast<double>(count_), cov);
+}
+
+void ColorStatistics::odMean(double mean[3]) const {
+	for (int i = 0; i < 3; ++i)
+		mean[i] = count_ ? od_sum_[i] / count_ : 0.0;
+}
+
+void ColorStatistics::odCovariance(double cov[6]) const {
+	covariance(od_sum_, od_product_, static_cast<double>(count_), cov);
+}
+
+void ColorStatistics::writeSumsHeader(std::ostream& os) {
+	os << "pixels,tissue_pixels,sum_r,sum_g,sum_b,"
+		<< "sum_rr,sum_rg,sum_rb,sum_gg,sum_gb,sum_bb,"
+		<< "od_sum_r,od_sum_g,od_sum_b,"
+		<< "od_sum_rr,od_sum_rg,od_sum_rb,od_sum_gg,od_sum_gb,od_sum_bb";
+}
+
+void ColorStatistics::writeSums(std::ostream& os) const {
+	// Full precision so that merged sums do not drift
+	auto precision = os.precision(17);
+	os << count_ << "," << tissue_count_;
+	for (int i = 0; i < 3; ++i)
+		os << "," << sum_[i];
+	for (int i = 0; i < 6; ++i)
+		os << "," << product_[i];
+	for (int i = 0; i < 3; ++i)
+		os << "," << od_sum_[i];
+	for (int i = 0; i < 6; ++i)
+		os << "," << od_product_[i];
+	os.precision(precision);
+}
+
+void ColorStatistics::writeSummaryHeader(std::ostream& os) {
+	os << "pixels,tissue_pixels,mean_r,mean_g,mean_b,"
+		<< "cov_rr,cov_rg,cov_rb,cov_gg,cov_gb,cov_bb,"
+		<< "od_mean_r,od_mean_g,od_mean_b,"
+		<< "od_cov_rr,od_cov_rg,od_cov_rb,od_cov_gg,od_cov_gb,od_cov_bb";
+}
+
+void ColorStatistics::writeSummary(std::ostream& os) const {
+	double mean[3], cov[6];
+	os << count_ << "," << tissue_count_;
+	rgbMean(mean);
+	rgbCovariance(cov);
+	for (int i = 0; i < 3; ++i)
+		os << "," << mean[i];
+	for (int i = 0; i < 6; ++i)
+		os << "," << cov[i];
+	odMean(mean);
+	odCovariance(cov);
+	for (int i = 0; i < 3; ++i)
+		os << "," << mean[i];
+	for (int i = 0; i < 6; ++i)
+		os << "," << cov[i];
+}
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,103 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#ifndef SEDEEN_SRC_TILEEXTRACTION_COLORSTATISTICS_H
+#define SEDEEN_SRC_TILEEXTRACTION_COLORSTATISTICS_H
+
+// System headers
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+namespace sedeen {
+namespace algorithm {
+
+/// Colour statistics of a set of RGB pixels, for stain normalisation and QC
+//
+/// Only sums are stored, so statistics of several tiles can be merged into a
+/// slide-level aggregate (or slides into a cohort) by adding them together.
+/// Means and covariances are derived from the sums on request, both in RGB
+/// and in optical density (OD = -log10((I + 1) / 256)) space.
+class ColorStatistics {
+ public:
+  ColorStatistics();
+
+  /// Accumulates \a count interleaved 8-bit RGB pixels
+  void accumulate(const uint8_t* rgb, size_t count);
+
+  /// Adds the sums of \a other to this object
+  void merge(const ColorStatistics& other);
+
+  /// Number of accumulated pixels
+  uint64_t pixelCount() const { return count_; }
+
+  /// Number of accumulated pixels whose mean OD marks them as tissue
+  uint64_t tissuePixelCount() const { return tissue_count_; }
+
+  /// Per-channel mean of the RGB values
+  void rgbMean(double mean[3]) const;
+
+  /// Upper triangle (rr, rg, rb, gg, gb, bb) of the RGB covariance
+  void rgbCovariance(double cov[6]) const;
+
+  /// Per-channel mean of the optical densities
+  void odMean(double mean[3]) const;
+
+  /// Upper triangle (rr, rg, rb, gg, gb, bb) of the OD covariance
+  void odCovariance(double cov[6]) const;
+
+  /// Writes the column names of writeSums() as comma separated values
+  static void writeSumsHeader(std::ostream& os);
+
+  /// Writes the raw sums as comma separated values, suitable for merging
+  void writeSums(std::ostream& os) const;
+
+  /// Writes the column names of writeSummary() as comma separated values
+  static void writeSummaryHeader(std::ostream& os);
+
+  /// Writes the pixel counts, means and covariances as comma separated values
+  void writeSummary(std::ostream& os) const;
+
+ private:
+  uint64_t count_;
+  uint64_t tissue_count_;
+
+  /// Sums of r, g, b
+  uint64_t sum_[3];
+
+  /// Sums of the products rr, rg, rb, gg, gb, bb
+  uint64_t product_[6];
+
+  /// Sums of the optical densities
+  double od_sum_[3];
+
+  /// Sums of the optical density products rr, rg, rb, gg, gb, bb
+  double od_product_[6];
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif
@@ -0,0 +1,198 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#include "SlideHistogram.h"
+
+// System headers
+#include <algorithm>
+#include <cmath>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+// Number of lane-private sub-histograms; consecutive pixels update different
+// lanes so that runs of equal values do not serialise on the same counter
+const int LANES = 4;
+
+} // namespace
+
+SlideHistogram::SlideHistogram(const uint8_t* pixels, int width, int height,
+                               int channels, int block_size)
+    : channels_(channels),
+      block_size_(std::max(1, block_size)),
+      columns_((width + block_size_ - 1) / block_size_),
+      rows_((height + block_size_ - 1) / block_size_),
+      blocks_(static_cast<size_t>(columns_) * rows_ * channels),
+      totals_(channels) {
+	std::vector<std::array<uint32_t, 256>> lanes(static_cast<size_t>(LANES) * channels);
+	for (int by = 0; by < rows_; ++by) {
+		for (int bx = 0; bx < columns_; ++bx) {
+			for (auto& lane : lanes)
+				lane.fill(0);
+
+			int x0 = bx * block_size_, x1 = std::min(width, x0 + block_size_);
+			int y0 = by * block_size_, y1 = std::min(height, y0 + block_size_);
+			int span = x1 - x0;
+			for (int y = y0; y < y1; ++y) {
+				const uint8_t* row = pixels + (static_cast<size_t>(y) * width + x0) * channels;
+				for (int c = 0; c < channels; ++c) {
+					uint32_t* l0 = lanes[c * LANES].data();
+					uint32_t* l1 = lanes[c * LANES + 1].data();
+					uint32_t* l2 = lanes[c * LANES + 2].data();
+					uint32_t* l3 = lanes[c * LANES + 3].data();
+					int x = 0;
+					for (; x + LANES <= span; x += LANES) {
+						++l0[row[x * channels + c]];
+						++l1[row[(x + 1) * channels + c]];
+						++l2[row[(x + 2) * channels + c]];
+						++l3[row[(x + 3) * channels + c]];
+					}
+					for (; x < span; ++x)
+						++l0[row[x * channels + c]];
+				}
+			}
+
+			// Merge the lanes into the block and the image totals
+			for (int c = 0; c < channels; ++c) {
+				auto& block = blocks_[(static_cast<size_t>(by) * columns_ + bx) * channels + c];
+				for (int v = 0; v < 256; ++v) {
+					uint32_t count = 0;
+					for (int l = 0; l < LANES; ++l)
+						count += lanes[c * LANES + l][v];
+					block[v] = count;
+					totals_[c][v] += count;
+				}
+			}
+		}
+	}
+}
+
+Histogram SlideHistogram::region(int c, int x0, int y0, int x1, int y1) const {
+	Histogram histogram;
+	histogram.fill(0);
+	int bx0 = std::max(0, x0 / block_size_);
+	int by0 = std::max(0, y0 / block_size_);
+	int bx1 = std::min(columns_, (x1 + block_size_ - 1) / block_size_);
+	int by1 = std::min(rows_, (y1 + block_size_ - 1) / block_size_);
+	for (int by = by0; by < by1; ++by) {
+		for (int bx = bx0; bx < bx1; ++bx) {
+			const auto& block = blocks_[(static_cast<size_t>(by) * columns_ + bx) * channels_ + c];
+			for (int v = 0; v < 256; ++v)
+				histogram[v] += block[v];
+		}
+	}
+	return histogram;
+}
+
+int otsuThreshold(const Histogram& histogram) {
+	double total = 0.0, total_sum = 0.0;
+	for (int v = 0; v < 256; ++v) {
+		total += histogram[v];
+		total_sum += static_cast<double>(v) * histogram[v];
+	}
+
+	int threshold = 0;
+	double best = -1.0, weight = 0.0, sum = 0.0;
+	for (int t = 0; t < 255; ++t) {
+		weight += histogram[t];
+		sum += static_cast<double>(t) * histogram[t];
+		double other = total - weight;
+		if (0.0 == weight || 0.0 == other)
+			continue;
+		double difference = sum / weight - (total_sum - sum) / other;
+		double between = weight * other * difference * difference;
+		if (between > best) {
+			best = between;
+			threshold = t;
+		}
+	}
+	return threshold;
+}
+
+int triangleThreshold(const Histogram& histogram) {
+	int first = 0, last = 255, peak = 0;
+	while (first < 255 && 0 == histogram[first])
+		++first;
+	while (last > 0 && 0 == histogram[last])
+		--last;
+	if (first >= last)
+		return first;
+	for (int v = first; v <= last; ++v) {
+		if (histogram[v] > histogram[peak])
+			peak = v;
+	}
+
+	// Draw the line from the peak to the end of the longer tail
+	int end = (peak - first) > (last - peak) ? first : last;
+	double height = static_cast<double>(histogram[peak]);
+	double run = end - peak;
+	int threshold = peak;
+	double best = -1.0;
+	int step = end > peak ? 1 : -1;
+	for (int v = peak; v != end; v += step) {
+		// Vertical distance from the bin to the line, proportional to the
+		// perpendicular distance
+		double distance = height * (1.0 - (v - peak) / run) - histogram[v];
+		if (distance > best) {
+			best = distance;
+			threshold = v;
+		}
+	}
+	return threshold;
+}
+
+std::array<int, 2> multiOtsuThresholds(const Histogram& histogram) {
+	// Cumulative counts and sums, so that class statistics are O(1)
+	double count[257] = {0.0}, sum[257] = {0.0};
+	for (int v = 0; v < 256; ++v) {
+		count[v + 1] = count[v] + histogram[v];
+		sum[v + 1] = sum[v] + static_cast<double>(v) * histogram[v];
+	}
+
+	auto term = [&](int from, int to) {
+		double n = count[to] - count[from];
+		double s = sum[to] - sum[from];
+		return n > 0.0 ? s * s / n : 0.0;
+	};
+
+	std::array<int, 2> thresholds = {{0, 1}};
+	double best = -1.0;
+	for (int t1 = 0; t1 < 254; ++t1) {
+		for (int t2 = t1 + 1; t2 < 255; ++t2) {
+			double between = term(0, t1 + 1) + term(t1 + 1, t2 + 1) + term(t2 + 1, 256);
+			if (between > best) {
+				best = between;
+				thresholds[0] = t1;
+				thresholds[1] = t2;
+			}
+		}
+	}
+	return thresholds;
+}
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,98 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#ifndef SEDEEN_SRC_TILEEXTRACTION_SLIDEHISTOGRAM_H
+#define SEDEEN_SRC_TILEEXTRACTION_SLIDEHISTOGRAM_H
+
+// System headers
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+/// A 256-bin histogram of 8-bit values
+typedef std::array<uint64_t, 256> Histogram;
+
+/// Per-channel histograms of a down-sampled slide image
+//
+/// The histograms are computed in a single pass over the pixels and kept per
+/// square block of the image, so thresholds for any channel, any method or
+/// any block-aligned region can be derived later without reading the pixels
+/// again.
+class SlideHistogram {
+ public:
+  /// Computes the histograms of \a width x \a height interleaved pixels
+  //
+  /// \param block_size
+  /// Edge, in pixels, of the blocks histograms are kept for
+  SlideHistogram(const uint8_t* pixels, int width, int height, int channels,
+                 int block_size);
+
+  /// Number of channels
+  int channels() const { return channels_; }
+
+  /// Histogram of channel \a c over the whole image
+  const Histogram& channel(int c) const { return totals_[c]; }
+
+  /// Histogram of channel \a c over the blocks overlapping the region
+  /// [x0, x1) x [y0, y1), in pixels of the down-sampled image
+  Histogram region(int c, int x0, int y0, int x1, int y1) const;
+
+ private:
+  int channels_;
+  int block_size_;
+  int columns_;
+  int rows_;
+
+  /// Histograms of each block and channel, block-major
+  std::vector<std::array<uint32_t, 256>> blocks_;
+
+  /// Histograms of each channel over the whole image
+  std::vector<Histogram> totals_;
+};
+
+/// Threshold maximising the between-class variance (Otsu's method)
+//
+/// \return
+/// The largest value of the lower class
+int otsuThreshold(const Histogram& histogram);
+
+/// Threshold at the largest distance from the line joining the histogram
+/// peak to the far end of the histogram (triangle method)
+int triangleThreshold(const Histogram& histogram);
+
+/// Two thresholds splitting the histogram into three classes (multi-level Otsu)
+//
+/// \return
+/// The largest values of the lowest and of the middle class, in increasing
+/// order
+std::array<int, 2> multiOtsuThresholds(const Histogram& histogram);
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif
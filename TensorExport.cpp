@@ -0,0 +1,124 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#include "TensorExport.h"
+
+// System headers
+#include <Windows.h>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+// Identifies a record file and its layout version
+const char RECORD_MAGIC[8] = {'T', 'E', 'T', 'R', 'E', 'C', '0', '1'};
+
+// Size of the record file header: magic, count, height, width, channels
+const uint64_t RECORD_HEADER_SIZE = 32;
+
+static_assert(sizeof(TileRecord) == 32, "TileRecord must be packed");
+
+/// Builds a version 1.0 .npy header, padded so the array data is 64-byte aligned
+std::string npyHeader(uint64_t count, int height, int width, int channels) {
+	std::ostringstream dict;
+	dict << "{'descr': '|u1', 'fortran_order': False, 'shape': ("
+		<< count << ", " << height << ", " << width << ", " << channels << "), }";
+
+	// magic (6) + version (2) + header length (2) + dict + terminating newline
+	std::string header = dict.str();
+	size_t total = 10 + header.size() + 1;
+	header.append((64 - total % 64) % 64, ' ');
+	header.push_back('\n');
+
+	uint16_t length = static_cast<uint16_t>(header.size());
+	std::string prefix("\x93NUMPY\x01\x00", 8);
+	prefix.push_back(static_cast<char>(length & 0xff));
+	prefix.push_back(static_cast<char>(length >> 8));
+	return prefix + header;
+}
+
+} // namespace
+
+MappedFile::MappedFile(const std::string& path, uint64_t size)
+    : file_(INVALID_HANDLE_VALUE),
+      mapping_(nullptr),
+      data_(nullptr),
+      size_(size) {
+	file_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (INVALID_HANDLE_VALUE == file_)
+		throw std::runtime_error("Unable to create " + path);
+
+	// Mapping with an explicit size extends the file to that size
+	mapping_ = CreateFileMappingA(file_, NULL, PAGE_READWRITE,
+		static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xffffffff), NULL);
+	if (mapping_)
+		data_ = static_cast<uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0));
+
+	if (nullptr == data_) {
+		if (mapping_)
+			CloseHandle(mapping_);
+		CloseHandle(file_);
+		throw std::runtime_error("Unable to map " + path + " into memory");
+	}
+}
+
+MappedFile::~MappedFile() {
+	FlushViewOfFile(data_, 0);
+	UnmapViewOfFile(data_);
+	CloseHandle(mapping_);
+	CloseHandle(file_);
+}
+
+TileTensorWriter::TileTensorWriter(const std::string& base_name, uint64_t count,
+                                   int height, int width, int channels)
+    : tile_bytes_(static_cast<uint64_t>(height) * width * channels),
+      array_offset_(npyHeader(count, height, width, channels).size()),
+      array_(base_name + ".npy", array_offset_ + count * tile_bytes_),
+      records_(base_name + ".rec", RECORD_HEADER_SIZE + count * sizeof(TileRecord)) {
+	auto header = npyHeader(count, height, width, channels);
+	std::memcpy(array_.data(), header.data(), header.size());
+
+	int32_t dims[4] = {height, width, channels, 0};
+	std::memcpy(records_.data(), RECORD_MAGIC, sizeof(RECORD_MAGIC));
+	std::memcpy(records_.data() + 8, &count, sizeof(count));
+	std::memcpy(records_.data() + 16, dims, sizeof(dims));
+}
+
+uint8_t* TileTensorWriter::tile(uint64_t index) const {
+	return array_.data() + array_offset_ + index * tile_bytes_;
+}
+
+TileRecord& TileTensorWriter::record(uint64_t index) const {
+	return *reinterpret_cast<TileRecord*>(
+		records_.data() + RECORD_HEADER_SIZE + index * sizeof(TileRecord));
+}
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,120 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#ifndef SEDEEN_SRC_TILEEXTRACTION_TENSOREXPORT_H
+#define SEDEEN_SRC_TILEEXTRACTION_TENSOREXPORT_H
+
+// System headers
+#include <cstdint>
+#include <string>
+
+namespace sedeen {
+namespace algorithm {
+
+/// Metadata of one tile in a tensor export, stored at the same index as the
+/// tile in the pixel array
+struct TileRecord {
+  /// Column and row of the cell in the sampling grid
+  int32_t grid_x;
+  int32_t grid_y;
+
+  /// Pyramid level the tile was read from
+  int32_t level;
+
+  /// Top-left corner of the tile, in the pixel coordinates of \c level
+  int32_t x;
+  int32_t y;
+
+  /// Fraction of the cell's mask pixels that are tissue, in [0, 1]
+  float score;
+
+  /// Class label of the tile, -1 when unlabelled
+  int32_t label;
+
+  /// Unused, keeps the record 8-byte aligned
+  int32_t reserved;
+};
+
+/// A file of fixed size mapped into memory for writing
+class MappedFile {
+ public:
+  /// Creates (or truncates) the file at \a path with \a size bytes and maps it
+  //
+  /// \throws std::runtime_error if the file cannot be created or mapped
+  MappedFile(const std::string& path, uint64_t size);
+
+  /// Flushes the mapped view and closes the file
+  ~MappedFile();
+
+  /// Start of the mapped view
+  uint8_t* data() const { return data_; }
+
+ private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  void* file_;
+  void* mapping_;
+  uint8_t* data_;
+  uint64_t size_;
+};
+
+/// Writes tiles into a preallocated N x H x W x C uint8 array in .npy format
+//
+/// Both the array and the parallel record file are sized up front and mapped
+/// into memory, so any thread may fill tile \c i and record \c i at their
+/// fixed offsets without synchronisation. Loaders can map the .npy file
+/// directly (e.g. numpy.load(..., mmap_mode='r')) for zero-copy random access.
+class TileTensorWriter {
+ public:
+  /// Creates \a base_name.npy and \a base_name.rec for \a count tiles
+  TileTensorWriter(const std::string& base_name, uint64_t count,
+                   int height, int width, int channels);
+
+  /// Pixels of tile \a index, in row-major H x W x C order
+  uint8_t* tile(uint64_t index) const;
+
+  /// Record of tile \a index
+  TileRecord& record(uint64_t index) const;
+
+  /// Byte offset of tile \a index from the start of the .npy file
+  uint64_t tileOffset(uint64_t index) const {
+    return array_offset_ + index * tile_bytes_;
+  }
+
+  /// Number of bytes of a single tile
+  uint64_t tileBytes() const { return tile_bytes_; }
+
+ private:
+  uint64_t tile_bytes_;
+  uint64_t array_offset_;
+  MappedFile array_;
+  MappedFile records_;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif
@@ -23,6 +23,11 @@
  *=============================================================================*/
 
 #include "TileExtraction.h"
+#include "TensorExport.h"
+#include "TileIndex.h"
+#include "TileScheduler.h"
+#include "TileWriter.h"
+#include "TileResample.h"
 
 // DPTK headers
 #include "Algorithm.h"
@@ -31,6 +36,18 @@
 #include "Image.h"
 #include "archive\Session.h"
 
+// System headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <mutex>
+
 // Poco header needed for the macros below 
 #include <Poco/ClassLibrary.h>
 
@@ -43,6 +60,152 @@ POCO_END_MANIFEST
 namespace sedeen {
 namespace algorithm {
 
+namespace {
+
+// Number of channels of the pixel buffers tiles are copied into
+const int RGB_CHANNELS = 3;
+
+// Width, in pixels, a tile should at least have at the level used by the
+// quality filter
+const int QUALITY_TILE_SIZE = 64;
+
+// Edge, in pixels of the level being read, of the source areas a sweep
+// groups its tiles into
+const int SWEEP_AREA_SIZE = 1024;
+
+// Largest source area, in pixels, a sweep reads in one piece; larger unions
+// of tiles are read tile by tile
+const double MAX_SWEEP_AREA = 4096.0 * 4096.0;
+
+// Edge, in pixels of the down-sampled image, of the blocks slide histograms
+// are kept for
+const int HISTOGRAM_BLOCK_SIZE = 64;
+
+// Tiles read by one task of the shared scheduler; small enough for tasks of
+// other slides to interleave, large enough to amortise a Compositor
+const size_t TILES_PER_CHUNK = 16;
+
+// Source areas of a sweep read by one task of the shared scheduler
+const size_t SWEEP_AREAS_PER_CHUNK = 1;
+
+// Grid rows scored by one task of the shared scheduler
+const size_t SCORE_ROWS_PER_CHUNK = 8;
+
+/// Copies the pixels of \c image into \c dst as row-major H x W x C bytes
+//
+/// \c dst must hold \c width * \c height * \c channels bytes; pixels outside
+/// of \c image are left untouched.
+void copyPixels(const image::RawImage& image, int width, int height,
+                int channels, uint8_t* dst) {
+	// Rows keep the requested stride when the image is smaller
+	auto stride = static_cast<size_t>(width) * channels;
+	int copy_width = std::min(width, image.width());
+	for (int y = 0; y < std::min(height, image.height()); ++y) {
+		auto row = dst + y * stride;
+		for (int x = 0; x < copy_width; ++x)
+			for (int c = 0; c < channels; ++c)
+				row[x * channels + c] = image.at(x, y, c).as<uint8_t>();
+	}
+}
+
+/// Copies the \c width x \c height region at (\c x, \c y) of \c source,
+/// with all of its components
+image::RawImage cropImage(const image::RawImage& source, int x, int y,
+                          int width, int height) {
+	image::RawImage tile(Size(width, height), source.color());
+	for (int j = 0; j < height; ++j)
+		for (int i = 0; i < width; ++i)
+			for (int c = 0; c < source.components(); ++c)
+				tile.setValue(i, j, c, source.at(x + i, y + j, c));
+	return tile;
+}
+
+/// Reduces \c source to \c width x \c height
+//
+/// \c source is returned as is if it is not larger than the requested size.
+/// The RGB components are area-averaged; any further component (alpha) is
+/// taken from the nearest source pixel.
+image::RawImage reduceImage(const image::RawImage& source, int width, int height) {
+	if (source.width() <= width && source.height() <= height)
+		return source;
+
+	std::vector<uint8_t> pixels((size_t)source.width() * source.height() * RGB_CHANNELS);
+	copyPixels(source, source.width(), source.height(), RGB_CHANNELS, pixels.data());
+	width = std::min(width, source.width());
+	height = std::min(height, source.height());
+	auto reduced = reduceRgb(pixels.data(), source.width(), source.height(), width, height);
+
+	image::RawImage tile(Size(width, height), source.color());
+	for (int y = 0; y < height; ++y) {
+		int source_y = (int)(((int64_t)y * 2 + 1) * source.height() / (2 * height));
+		for (int x = 0; x < width; ++x) {
+			for (int c = 0; c < RGB_CHANNELS; ++c)
+				tile.setValue(x, y, c, reduced[((size_t)y * width + x) * RGB_CHANNELS + c]);
+			int source_x = (int)(((int64_t)x * 2 + 1) * source.width() / (2 * width));
+			for (int c = RGB_CHANNELS; c < source.components(); ++c)
+				tile.setValue(x, y, c, source.at(source_x, source_y, c));
+		}
+	}
+	return tile;
+}
+
+/// Copies \c tile into slot \c index of \c tensor and adds it to \c stats,
+/// each of which may be null
+//
+/// Pixels are written in place at the tile's slot of the tensor export, with
+/// no intermediate encode; \c pixels is only used when there is no tensor.
+void storeTilePixels(const image::RawImage& tile, int tile_size,
+                     const TilePlanEntry& entry, size_t index,
+                     TileTensorWriter* tensor, ColorStatistics* stats,
+                     std::vector<uint8_t>& pixels) {
+	uint8_t* tile_pixels = nullptr;
+	if (tensor)
+	{
+		tile_pixels = tensor->tile(index);
+		copyPixels(tile, tile_size, tile_size, RGB_CHANNELS, tile_pixels);
+		TileRecord record = { entry.grid_x, entry.grid_y, entry.level,
+			entry.x, entry.y, entry.score, -1, 0 };
+		tensor->record(index) = record;
+	}
+
+	if (stats)
+	{
+		// Only the pixels of the tile count; a tile smaller than tile_size is
+		// packed at its own width rather than padded with black
+		int width = std::min(tile_size, tile.width());
+		int height = std::min(tile_size, tile.height());
+		if (!tile_pixels || width != tile_size)
+		{
+			pixels.assign((size_t)width * height * RGB_CHANNELS, 0);
+			tile_pixels = pixels.data();
+			copyPixels(tile, width, height, RGB_CHANNELS, tile_pixels);
+		}
+		stats->accumulate(tile_pixels, (size_t)width * height);
+	}
+}
+
+/// Runs \c task over [0, \c count) in chunks of \c chunk_size on the shared
+/// scheduler, and waits for all the chunks
+//
+/// \c task receives the [begin, end) range of its chunk. The first exception
+/// thrown by a chunk is rethrown once all of them have finished.
+void runChunks(TileScheduler& scheduler, size_t count, size_t chunk_size,
+               const std::function<void(size_t, size_t)>& task) {
+	TileScheduler::TaskGroup group;
+	for (size_t begin = 0; begin < count; begin += chunk_size) {
+		auto end = std::min(count, begin + chunk_size);
+		scheduler.submit(group, [&task, begin, end]() { task(begin, end); });
+	}
+	scheduler.wait(group);
+}
+
+/// Runs \c task as a single unit on the shared scheduler and waits for it
+void runTask(TileScheduler& scheduler, const std::function<void()>& task) {
+	runChunks(scheduler, 1, 1, [&](size_t, size_t) { task(); });
+}
+
+} // namespace
+
 TileExtraction::TileExtraction()
     : box_width_(),
       box_spacing_(),
@@ -50,9 +213,11 @@ TileExtraction::TileExtraction()
       y_offset_(),
 	  optimal_threshold_(-1),
 	  channel_index_(1),
+	  slide_histogram_(),
+	  scheduler_(),
+	  threshold_method_(),
 	  downsample_size_(),
       scale_(1.0),
-	  scaleResolution_(4.0),
 	  display_area_(),
 	  window_size_(),
 	  threshold_(),
@@ -60,6 +225,19 @@ TileExtraction::TileExtraction()
 	  ResolutionLevel_(),
 	  save_option_(),
 	  saveFileDialogParam_(),
+	  mode_(),
+	  sweep_file_(),
+	  tensor_option_(),
+	  durability_option_(),
+	  stats_option_(),
+	  quality_option_(),
+	  min_sharpness_(),
+	  max_pen_fraction_(),
+	  max_dark_fraction_(),
+	  region_option_(),
+	  annotation_file_(),
+	  min_coverage_(),
+	  output_text_(),
 	  output_option_(),
 	  channel_factory_(),
       threshold_factory_(),
@@ -74,8 +252,13 @@ TileExtraction::~TileExtraction() {
 void TileExtraction::run() {
 
 	// On the first call to this method, determine optimal threshold value
-	if (-1 == optimal_threshold_) {
-		optimal_threshold_ = getOptimalThreshold();
+	if (-1 == optimal_threshold_ || threshold_method_.isChanged()) {
+		auto threshold = getOptimalThreshold();
+		if (threshold != optimal_threshold_) {
+			// Rebuild the pipeline from the thresholding stage
+			optimal_threshold_ = threshold;
+			threshold_factory_.reset();
+		}
 	}
 
 	// Build pipeline by chaining together all of the kernels
@@ -85,11 +268,21 @@ void TileExtraction::run() {
 
 	if ( pipeline_changed ) 
 	{
-
-		drawTileBox( );
-		if((int)save_option_)
+		if (PLAN_TILES == (int)mode_)
+		{
+			planTiles();
+		}
+		else if (SWEEP_CONFIGURATIONS == (int)mode_)
 		{
-			SaveToXMLFile();
+			sweepTiles();
+		}
+		else
+		{
+			drawTileBox( );
+			if((int)save_option_)
+			{
+				SaveToXMLFile(m_roi_file_name + "_session.xml");
+			}
 		}
 	}
 
@@ -101,11 +294,17 @@ void TileExtraction::run() {
 
 void TileExtraction::init(const image::ImageHandle& input_image) {
 
+	// Share the worker threads and resource limits with the other slides
+	scheduler_ = TileScheduler::shared();
+
 	results_ = createOverlayResult(*this);
 
 	// Bind intermediate result image to UI
 	intermediate_result_ = createImageResult(*this, "Final Image");
 
+	// Bind plan report to UI
+	output_text_ = createTextResult(*this, "Plan Estimate");
+
 	// Default number of regions to place along the narrowest dimension.
 	const auto DEFAULT_NUM_REGIONS = 8;
 	// Default fraction of the spacing occupied by the ROI
@@ -163,6 +362,18 @@ void TileExtraction::init(const image::ImageHandle& input_image) {
 		10,  // maximum value
 		false);
 
+	std::vector<std::string> threshold_methods;
+	threshold_methods.push_back("Otsu");
+	threshold_methods.push_back("Triangle");
+	threshold_methods.push_back("Multi-Otsu");
+	threshold_method_ = createOptionParameter(
+		*this,
+		"Threshold Method",
+		"Method used to separate tissue from background in the selected channel",
+		0,                  // initial selection
+		threshold_methods,
+		false);   // option list
+
 	threshold_ = createDoubleParameter(*this,
 		"Threshold",
 		"Threshold to identify tissue regions",
@@ -171,9 +382,74 @@ void TileExtraction::init(const image::ImageHandle& input_image) {
 		1,   // maximum value
 		false);
 
+	//Create annotation region options and bind members to UI
+	std::vector<std::string> region_options;
+	region_options.push_back("Whole Slide");
+	region_options.push_back("Inside Annotations");
+	region_option_ = createOptionParameter(
+		*this,
+		"Region",
+		"Place tiles over the whole slide or only inside the annotated regions",
+		0,                  // initial selection
+		region_options,
+		false);   // option list
+
+	file::FileDialogOptions sessionDialogOptions;
+	file::FileDialogFilter sessionDialogFilter;
+	sessionDialogFilter.name = "Session XML(*.xml)";
+	sessionDialogOptions.filters.push_back(sessionDialogFilter);
+	sessionDialogOptions.startDir = input_image->getMetaData()->get(image::StringTags::SOURCE_DESCRIPTION, 0);
+	annotation_file_ = createOpenFileDialogParameter(*this,
+		"Annotation Session",
+		"Session XML holding the annotation regions; defaults to the session of the image",
+		sessionDialogOptions,
+		true);
+
+	min_coverage_ = createDoubleParameter(*this,
+		"Min Annotation Coverage",
+		"Minimum fraction of a tile that must lie inside the annotated regions",
+		0.5, // initial value 50%
+		0.0, // minimum value
+		1,   // maximum value
+		false);
+
+	//Create quality filter options and bind members to UI
+	std::vector<std::string> quality_options;
+	quality_options.push_back("OFF");
+	quality_options.push_back("ON");
+	quality_option_ = createOptionParameter(
+		*this,
+		"Quality Filter",
+		"If ON, blurry, pen-marked or folded tiles are rejected before they are read at full resolution",
+		0,                  // initial selection
+		quality_options,
+		false);   // option list
+
+	min_sharpness_ = createDoubleParameter(*this,
+		"Min Sharpness",
+		"Minimum variance of the Laplacian of a tile, measured at a coarse level",
+		10.0, // initial value
+		0.0,  // minimum value
+		1000.0, // maximum value
+		false);
+
+	max_pen_fraction_ = createDoubleParameter(*this,
+		"Max Pen Fraction",
+		"Maximum fraction of a tile covered by marker pen ink",
+		0.05, // initial value 5%
+		0.0,  // minimum value
+		1,    // maximum value
+		false);
+
+	max_dark_fraction_ = createDoubleParameter(*this,
+		"Max Dark Fraction",
+		"Maximum fraction of very dark pixels in a tile, typical of tissue folds",
+		0.2,  // initial value 20%
+		0.0,  // minimum value
+		1,    // maximum value
+		false);
+
 	//Create resolution option list and bind member to UI
-	scaleResolution_ = std::min( image_size.width() /getDimensions(input_image, 1).width(),
-		 image_size.height() /getDimensions(input_image, 1).height());
 	numResolutionLevel_ = getNumResolutionLevels(input_image)-1;
 	double maxMagnificationm = getMaximumMagnification(input_image);
 
@@ -215,6 +491,34 @@ void TileExtraction::init(const image::ImageHandle& input_image) {
 		save_options,
 		false);   // option list
 
+	tensor_option_ = createOptionParameter(
+		*this,
+		"Tensor Export",
+		"If ON, saved tiles are also written into a memory-mappable .npy array with a parallel record file",
+		0,                  // initial selection
+		save_options,
+		false);   // option list
+
+	std::vector<std::string> durability_options;
+	durability_options.push_back("None");
+	durability_options.push_back("Per Batch");
+	durability_options.push_back("Per File");
+	durability_option_ = createOptionParameter(
+		*this,
+		"Durability",
+		"When saved tiles are flushed to disk: left to the system, in batches, or after every file",
+		0,                  // initial selection
+		durability_options,
+		false);   // option list
+
+	stats_option_ = createOptionParameter(
+		*this,
+		"Color Statistics",
+		"If ON, RGB and optical density statistics of each saved tile are added to the manifest",
+		0,                  // initial selection
+		save_options,
+		false);   // option list
+
 	file::FileDialogOptions fileDialogOptions;
 	file::FileDialogFilter fileDialogFilter;
 	fileDialogFilter.name = "TIFF(*.tif)";
@@ -251,6 +555,32 @@ void TileExtraction::init(const image::ImageHandle& input_image) {
 		fileDialogOptions,
 		false);
 
+	//Create mode option list and bind member to UI
+	std::vector<std::string> mode_options;
+	mode_options.push_back("Extract Tiles");
+	mode_options.push_back("Plan Only");
+	mode_options.push_back("Extract From Plan");
+	mode_options.push_back("Sweep Configurations");
+	mode_ = createOptionParameter(
+		*this,
+		"Mode",
+		"Plan Only scores the grid and writes a tile plan with cost estimates; Extract From Plan reuses it without scoring; "
+		"Sweep Configurations extracts every configuration of the sweep file in one pass",
+		EXTRACT_TILES,      // initial selection
+		mode_options,
+		false);   // option list
+
+	file::FileDialogOptions sweepDialogOptions;
+	file::FileDialogFilter sweepDialogFilter;
+	sweepDialogFilter.name = "Text Files(*.txt)";
+	sweepDialogOptions.filters.push_back(sweepDialogFilter);
+	sweepDialogOptions.startDir = input_image->getMetaData()->get(image::StringTags::SOURCE_DESCRIPTION, 0);
+	sweep_file_ = createOpenFileDialogParameter(*this,
+		"Sweep Configurations",
+		"One configuration per line: size spacing x-offset y-offset resolution (e.g. 512 1024 0 0 20.0X)",
+		sweepDialogOptions,
+		true);
+
 	// Create output option list and bind member to UI
 	std::vector<std::string> compute_options;
 	compute_options.push_back("None");
@@ -280,8 +610,22 @@ bool TileExtraction::parametersChanged() {
 		x_offset_.isChanged() ||
 		y_offset_.isChanged() ||
 		window_size_.isChanged() ||
-		(ResolutionLevel_.isChanged() && save_option_) ||
+		threshold_method_.isChanged() ||
+		(ResolutionLevel_.isChanged() && (save_option_ || quality_option_ ||
+			PLAN_TILES == (int)mode_)) ||
 		save_option_.isChanged() ||
+		mode_.isChanged() ||
+		(sweep_file_.isChanged() && SWEEP_CONFIGURATIONS == (int)mode_) ||
+		(tensor_option_.isChanged() && save_option_) ||
+		(durability_option_.isChanged() && save_option_) ||
+		(stats_option_.isChanged() && save_option_) ||
+		quality_option_.isChanged() ||
+		(min_sharpness_.isChanged() && quality_option_) ||
+		(max_pen_fraction_.isChanged() && quality_option_) ||
+		(max_dark_fraction_.isChanged() && quality_option_) ||
+		region_option_.isChanged() ||
+		(annotation_file_.isChanged() && region_option_) ||
+		(min_coverage_.isChanged() && region_option_) ||
 		threshold_.isChanged();
 }
 
@@ -351,7 +695,10 @@ bool TileExtraction::buildPipeline(int threshold) {
 		pipeline_changed = true;
 	}
 
-	if ( parametersChanged() && (int)save_option_ ) 
+	// A sweep without "Save Tiles" only draws the tiles and writes nothing
+	bool writes_files = (int)save_option_ ||
+		(EXTRACT_TILES != (int)mode_ && SWEEP_CONFIGURATIONS != (int)mode_);
+	if ( parametersChanged() && writes_files ) 
 	{
 		//QMessageBox msgBox;
 
@@ -385,19 +732,39 @@ bool TileExtraction::buildPipeline(int threshold) {
 int TileExtraction::getOptimalThreshold() {
 	using namespace image::tile;
 
-	// Get image source
-	auto source_factory = image()->getFactory();
-	auto source_color = source_factory->getColorSpace();
-
-	// build kernel
-	auto kernel = 
-		std::make_shared<image::tile::ChannelSelect>(channel_index_, source_color);
+	// Histograms of all channels are computed in one pass over the
+	// down-sampled image and kept for later calls
+	if (nullptr == slide_histogram_) {
+		runTask(*scheduler_, [&]() {
+			const size_t bytes =
+				(size_t)downsample_size_.width() * downsample_size_.height() * RGB_CHANNELS;
+			TileScheduler::MemoryReservation memory(*scheduler_, 2 * bytes);
+			auto compositor = std::unique_ptr<Compositor>(new Compositor(image()->getFactory()));
+			auto source_region = image()->getFactory()->getLevelRegion(0);
+			image::RawImage source_image;
+			{
+				TileScheduler::IoSlot io(*scheduler_);
+				source_image = compositor->getImage(source_region, downsample_size_);
+			}
 
-	// Build the channel select Kernel
-	auto factory = 
-		std::make_shared<image::tile::FilterFactory>(source_factory, kernel);
+			std::vector<uint8_t> pixels(bytes, 0);
+			copyPixels(source_image, downsample_size_.width(), downsample_size_.height(),
+				RGB_CHANNELS, pixels.data());
+			slide_histogram_.reset(new SlideHistogram(pixels.data(), downsample_size_.width(),
+				downsample_size_.height(), RGB_CHANNELS, HISTOGRAM_BLOCK_SIZE));
+		});
+	}
 
-	return image::OtsuThresholdValue(factory, downsample_size_);
+	const auto& histogram = slide_histogram_->channel(channel_index_);
+	switch ((int)threshold_method_) {
+	case 1:
+		return triangleThreshold(histogram);
+	case 2:
+		// Background is the brightest of the three classes
+		return multiOtsuThresholds(histogram)[1];
+	default:
+		return otsuThreshold(histogram);
+	}
 }
 
 void TileExtraction::updateIntermediateResult() {
@@ -439,7 +806,7 @@ void TileExtraction::updateIntermediateResult() {
    
 }
 
-void TileExtraction::SaveToXMLFile()
+void TileExtraction::SaveToXMLFile(const std::string& file_name)
 {
 	using namespace image::tile;
 
@@ -452,7 +819,7 @@ void TileExtraction::SaveToXMLFile()
 	std::ofstream txtfile;
 	std::string path_to_image = 
 			image()->getMetaData()->get(image::StringTags::SOURCE_DESCRIPTION, 0);
-	txtfile.open(m_roi_file_name + "_session.xml");
+	txtfile.open(file_name);
 	txtfile<<"<?xml version=\"1.0\"?>\n";
 	txtfile<<"<session software=\"PathCore Session Printer\" version=\"0.1.0\">\n";
 	txtfile<<"    <image identifier=\""<<path_to_image+"\">\n";
@@ -496,138 +863,820 @@ void TileExtraction::SaveToXMLFile()
 
 void TileExtraction::drawTileBox()
 {
-	using namespace image::tile;
-	int selectedResolution =0;
-	if(ResolutionLevel_.isUserDefined())
+	TilePlanHeader header;
+	std::vector<TilePlanEntry> entries;
+	if (EXTRACT_FROM_PLAN == (int)mode_)
 	{
-		selectedResolution = (int)ResolutionLevel_;
+		// Skip the scoring stage, the plan already lists the accepted tiles
+		readTilePlan(planFileName(), header, entries);
+		auto image_size = getDimensions(image(), 0);
+		if (header.image_width != image_size.width() || 
+			header.image_height != image_size.height())
+		{
+			throw std::runtime_error("The tile plan was created for a different image!");
+		}
+	}
+	else
+	{
+		header = currentPlanHeader();
+		entries = scoreTiles(header, computeMaskIntegral(), readAnnotations());
 	}
 
-	auto image_size = getDimensions(image(), 0);
+	tiles_.clear();
+
+	// Clear old ROIs
+	results_.clear();
+
+	PointF box_size(header.box_width, header.box_width);
+
+	// Draw each ROI
+	std::vector<TilePlanEntry> exports;
+	for (const auto& entry : entries) {
+		if (askedToStop()) break;
+		PointF top_left = tileOrigin(header, entry);
+		PointF bottom_right = PointF(top_left.getX() + box_size.getX(),
+			top_left.getY() + box_size.getY());
+
+		auto graphic_style = GraphicStyle();
+		results_.drawRectangle(Rectangle(top_left, bottom_right, 0, sedeen::Center),
+			graphic_style,
+			"Name", "Description");
+
+		if((int)save_option_ && isInsideImage(header, entry))
+		{
+			exports.push_back(entry);
+
+			//XML file
+			addTileGraphic(header, entry);
+		}
+	}
+
+	exportTiles(header, exports);
+}
+
+void TileExtraction::addTileGraphic(const TilePlanHeader& header, const TilePlanEntry& entry)
+{
+	PointF top_left = tileOrigin(header, entry);
+	PointF bottom_right = PointF(top_left.getX() + header.box_width,
+		top_left.getY() + header.box_width);
+
+	GraphicInfo roi_info;
+	roi_info.red = 181;
+	roi_info.green = 230;
+	roi_info.blue = 29;
+	roi_info.region = "Region " + std::to_string(tiles_.size() + 1);
+	roi_info.style = GraphicStyle();
+	roi_info.description = " ";
+	roi_info.type = "rectangle";
+	roi_info.points.push_back(top_left);
+	roi_info.points.push_back(PointF(bottom_right.getX(), top_left.getY()));
+	roi_info.points.push_back(bottom_right);
+	roi_info.points.push_back(PointF(top_left.getX(), bottom_right.getY()));
+	tiles_.push_back(roi_info);
+}
+
+void TileExtraction::planTiles()
+{
+	auto header = currentPlanHeader();
+	auto entries = scoreTiles(header, computeMaskIntegral(), readAnnotations());
+
+	// Only the tiles an extraction would save are kept in the plan
+	entries.erase(std::remove_if(entries.begin(), entries.end(),
+		[&](const TilePlanEntry& entry) { return !isInsideImage(header, entry); }),
+		entries.end());
+
+	tiles_.clear();
+	results_.clear();
+	for (const auto& entry : entries) {
+		PointF top_left = tileOrigin(header, entry);
+		PointF bottom_right = PointF(top_left.getX() + header.box_width,
+			top_left.getY() + header.box_width);
+		results_.drawRectangle(Rectangle(top_left, bottom_right, 0, sedeen::Center),
+			GraphicStyle(),
+			"Name", "Description");
+	}
+
+	writeTilePlan(planFileName(), header, entries);
+
+	auto report = formatTilePlanEstimate(calibrateCost(header, entries));
+	std::ofstream txtfile(tileBaseName() + "_plan.txt");
+	txtfile << report;
+	output_text_.sendText(report);
+}
 
-	// Get image from the current output image
-	auto compositor = std::unique_ptr<Compositor>(new Compositor(morphology_factory_));
-	auto source_region = image()->getFactory()->getLevelRegion(0);
-	auto update_image = compositor->getImage(source_region, downsample_size_);
+TileExtraction::MaskIntegral TileExtraction::computeMaskIntegral()
+{
+	using namespace image::tile;
+
+	// Summed-area table with a leading row and column of zeros
+	const int width = downsample_size_.width();
+	const int height = downsample_size_.height();
+	MaskIntegral mask;
+	mask.sums.assign((size_t)(width + 1) * (height + 1), 0.0);
+	mask.max_value = 0.0;
+
+	// The mask pipeline runs as one unit of the shared scheduler
+	runTask(*scheduler_, [&]() {
+		TileScheduler::MemoryReservation memory(*scheduler_, (uint64_t)width * height * RGB_CHANNELS);
+
+		// Get image from the current output image
+		auto compositor = std::unique_ptr<Compositor>(new Compositor(morphology_factory_));
+		auto source_region = image()->getFactory()->getLevelRegion(0);
+		image::RawImage update_image;
+		{
+			TileScheduler::IoSlot io(*scheduler_);
+			update_image = compositor->getImage(source_region, downsample_size_);
+		}
+
+		for (int y = 0; y < height; ++y) {
+			double row_sum = 0.0;
+			double* above = &mask.sums[(size_t)y * (width + 1)];
+			double* row = above + (width + 1);
+			for (int x = 0; x < width; ++x) {
+				double value = update_image.at(x, y, 0).as<double>();
+				mask.max_value = std::max(mask.max_value, value);
+				row_sum += value;
+				row[x + 1] = above[x + 1] + row_sum;
+			}
+		}
+	});
+	return mask;
+}
+
+std::vector<TilePlanEntry> TileExtraction::scoreTiles(const TilePlanHeader& header,
+                                                      const MaskIntegral& mask,
+                                                      const std::vector<AnnotationPolygon>& annotation_polygons)
+{
+	const int mask_width = downsample_size_.width();
+	const int mask_height = downsample_size_.height();
 
 	// Compute the number of ROIs to draw in each direction
 	const auto NUM_BOXES_X =
-		(box_spacing_ - 1 + (image_size.width() - x_offset_)) / box_spacing_;
+		(header.box_spacing - 1 + (header.image_width - header.x_offset)) / header.box_spacing;
 	const auto NUM_BOXES_Y =
-		(box_spacing_ - 1 + (image_size.height() - y_offset_)) / box_spacing_;
+		(header.box_spacing - 1 + (header.image_height - header.y_offset)) / header.box_spacing;
+
+	// Tiles are read from the coarsest stored level that is not coarser than
+	// the selected resolution, and reduced from there by readTile()
+	int source_level = sourceLevel(header.level);
+	auto image_size_selectedRes = getDimensions(image(), source_level);
+	double scale_x = (double)image_size_selectedRes.width() / (double)header.image_width;
+	double scale_y = (double)image_size_selectedRes.height() / (double)header.image_height;
+
+	// Size of the tile at the source level
+	int tile_width = std::max(1, (int)(header.box_width * scale_x + 0.5));
+	int tile_height = std::max(1, (int)(header.box_width * scale_y + 0.5));
+
+	// Index the annotations with cells matching the grid spacing, so that
+	// each tile only meets the polygon edges passing close to it
+	std::unique_ptr<AnnotationIndex> annotations;
+	const double min_coverage = min_coverage_;
+	if (!annotation_polygons.empty())
+	{
+		annotations.reset(new AnnotationIndex(annotation_polygons, header.box_spacing));
+	}
 
-	PointF box_size(box_width_, box_width_);
+	// Rows of the grid are scored in chunks on the shared scheduler
+	std::vector<std::vector<TilePlanEntry>> rows(std::max(0, (int)NUM_BOXES_Y));
+	runChunks(*scheduler_, rows.size(), SCORE_ROWS_PER_CHUNK, [&](size_t begin, size_t end) {
+		for (int y = (int)begin; (int)end != y; ++y) {
+			if (askedToStop()) break;
+			for (int x = 0; NUM_BOXES_X != x; ++x) {
+				if (askedToStop()) break;
+				TilePlanEntry entry;
+				entry.grid_x = x;
+				entry.grid_y = y;
+				PointF top_left = tileOrigin(header, entry);
+				PointF bottom_right = PointF(top_left.getX() + header.box_width,
+					top_left.getY() + header.box_width);
+
+				// Eliminating the cells outside of the annotations; a cell must
+				// touch an annotation even when the minimum coverage is 0
+				if (annotations)
+				{
+					double covered = annotations->coverage(top_left.getX(), top_left.getY(),
+						bottom_right.getX(), bottom_right.getY());
+					if (covered <= 0.0 || covered < min_coverage)
+						continue;
+				}
 
-	tiles_.clear();
+				// Eliminating the background
+				PointF top_left_scaled = PointF(top_left.getX()*scale_, 
+					top_left.getY()*scale_);
+				PointF bottom_right_scaled = PointF(bottom_right.getX()*scale_, 
+					bottom_right.getY()*scale_);
+
+				// Sum of the mask over the cell, from the summed-area table
+				double sum = 0.0;
+				double coverage = 0.0;
+				int x0 = std::max(0, (int)top_left_scaled.getX());
+				int y0 = std::max(0, (int)top_left_scaled.getY());
+				int x1 = std::min((int)bottom_right_scaled.getX(), mask_width);
+				int y1 = std::min((int)bottom_right_scaled.getY(), mask_height);
+				if (x0 < x1 && y0 < y1)
+				{
+					const size_t stride = mask_width + 1;
+					sum = mask.sums[y1 * stride + x1] - mask.sums[y0 * stride + x1] -
+						mask.sums[y1 * stride + x0] + mask.sums[y0 * stride + x0];
+					if (mask.max_value > 0.0)
+						coverage = sum / ((double)(x1 - x0) * (y1 - y0) * mask.max_value);
+				}
 
-	// Clear old ROIs
-	results_.clear();
+				// The threshold keeps its original scale; the entry stores the
+				// fraction of the cell's mask pixels that are tissue
+				double box_area_scaled = (double)header.box_width*header.box_width*scale_;
+				double score = sum/box_area_scaled;
+				if( score > header.threshold)
+				{
+					entry.level = source_level;
+					entry.x = (int)(top_left.getX()*scale_x);
+					entry.y = (int)(top_left.getY()*scale_y);
+					entry.width = tile_width;
+					entry.height = tile_height;
+					entry.score = (float)coverage;
+					rows[y].push_back(entry);
+				}
+			}
+		}
+	});
 
-	auto image_size_selectedRes = getDimensions(image(), selectedResolution);
-	double scale_x = (double)image_size_selectedRes.width() / (double)image_size.width();
-	double scale_y = (double)image_size_selectedRes.height() / (double)image_size.height();	
+	std::vector<TilePlanEntry> entries;
+	for (const auto& row : rows)
+		entries.insert(entries.end(), row.begin(), row.end());
 
-	// Draw each ROI
-	int num_tiles =1;
-	for (int y = 0; NUM_BOXES_Y != y; ++y) {
+	if ((int)quality_option_)
+	{
+		// Cells crossing the image border are never saved, don't read them
+		entries.erase(std::remove_if(entries.begin(), entries.end(),
+			[&](const TilePlanEntry& entry) { return !isInsideImage(header, entry); }),
+			entries.end());
+		filterTileQuality(header, entries);
+	}
+
+	return entries;
+}
+
+void TileExtraction::sweepTiles()
+{
+	using namespace image::tile;
+
+	auto configurations = readSweepConfigurations();
+
+	// The mask is scored once for all the configurations
+	auto mask = computeMaskIntegral();
+	auto annotation_polygons = readAnnotations();
+
+	// Tiles of every configuration, grouped by the source area they start in
+	struct SweepTile {
+		size_t configuration;
+		size_t index;
+	};
+	std::vector<std::vector<TilePlanEntry>> entries(configurations.size());
+	std::map<std::pair<int, std::pair<int, int>>, std::vector<SweepTile>> areas;
+
+	tiles_.clear();
+	results_.clear();
+	for (size_t k = 0; k < configurations.size(); ++k) {
 		if (askedToStop()) break;
-		for (int x = 0; NUM_BOXES_X != x; ++x) {
+		const auto& header = configurations[k];
+		entries[k] = scoreTiles(header, mask, annotation_polygons);
+		entries[k].erase(std::remove_if(entries[k].begin(), entries[k].end(),
+			[&](const TilePlanEntry& entry) { return !isInsideImage(header, entry); }),
+			entries[k].end());
+
+		for (size_t i = 0; i < entries[k].size(); ++i) {
+			const auto& entry = entries[k][i];
+			PointF top_left = tileOrigin(header, entry);
+			PointF bottom_right = PointF(top_left.getX() + header.box_width,
+				top_left.getY() + header.box_width);
+			results_.drawRectangle(Rectangle(top_left, bottom_right, 0, sedeen::Center),
+				GraphicStyle(),
+				"Name", "Description");
+
+			SweepTile tile = { k, i };
+			areas[std::make_pair(entry.level, std::make_pair(entry.x / SWEEP_AREA_SIZE,
+				entry.y / SWEEP_AREA_SIZE))].push_back(tile);
+		}
+	}
+
+	// Without "Save Tiles" a sweep only shows the tiles of every configuration
+	if (!(int)save_option_ || askedToStop())
+		return;
+
+	auto sweepBaseName = [&](size_t k) {
+		return tileBaseName() + "_config" + std::to_string(k + 1);
+	};
+
+	// Each configuration gets its own tensor export and statistics
+	std::vector<std::unique_ptr<TileTensorWriter>> tensors(configurations.size());
+	std::vector<std::vector<ColorStatistics>> stats(configurations.size());
+	bool compute_stats = 0 != (int)stats_option_;
+	for (size_t k = 0; k < configurations.size(); ++k) {
+		auto tile_size = outputTileSize(configurations[k]);
+		if ((int)tensor_option_ && !entries[k].empty())
+		{
+			tensors[k].reset(new TileTensorWriter(sweepBaseName(k) + "_tiles",
+				entries[k].size(), tile_size, tile_size, RGB_CHANNELS));
+		}
+		if (compute_stats)
+			stats[k].resize(entries[k].size());
+	}
+
+	std::vector<const std::vector<SweepTile>*> work;
+	for (const auto& area : areas)
+		work.push_back(&area.second);
+
+	// Read the union of each area's tiles once and cut all of them from it
+	TileWriter writer(*scheduler_, (TileWriter::Durability)(int)durability_option_);
+	runChunks(*scheduler_, work.size(), SWEEP_AREAS_PER_CHUNK, [&](size_t begin, size_t end) {
+		auto compositor = std::unique_ptr<Compositor>(new Compositor(image()->getFactory()));
+		std::vector<uint8_t> pixels;
+		for (size_t a = begin; a < end; ++a) {
 			if (askedToStop()) break;
-			PointF top_left(x_offset_ + x * box_spacing_,
-				y_offset_ + y * box_spacing_);
-			PointF bottom_right = PointF(top_left.getX() + box_size.getX(),
-				top_left.getY() + box_size.getY());
-
-			// Eliminating the background
-			PointF top_left_scaled = PointF(top_left.getX()*scale_, 
-				top_left.getY()*scale_);
-			PointF bottom_right_scaled = PointF(bottom_right.getX()*scale_, 
-				bottom_right.getY()*scale_);
-
-			double sum = 0.0;
-			int idx_y =(int)top_left_scaled.getY();
-			while( (idx_y < (int)bottom_right_scaled.getY()) && (idx_y < downsample_size_.height()) )
+			const auto& area_tiles = *work[a];
+			const auto& first = entries[area_tiles.front().configuration][area_tiles.front().index];
+			int x0 = first.x, y0 = first.y;
+			int x1 = first.x + first.width, y1 = first.y + first.height;
+			for (const auto& tile : area_tiles) {
+				const auto& entry = entries[tile.configuration][tile.index];
+				x0 = std::min(x0, entry.x);
+				y0 = std::min(y0, entry.y);
+				x1 = std::max(x1, entry.x + entry.width);
+				y1 = std::max(y1, entry.y + entry.height);
+			}
+
+			// One reservation covers the area and all of its queued tiles, and
+			// is released once the last of them is saved
+			image::RawImage source;
+			bool whole_area = (double)(x1 - x0) * (y1 - y0) <= MAX_SWEEP_AREA;
+			std::shared_ptr<TileScheduler::MemoryReservation> memory;
+			if (whole_area)
 			{
-				if (askedToStop()) break;
-				int idx_x =(int)top_left_scaled.getX();
-				while( (idx_x < (int)bottom_right_scaled.getX()) && (idx_x < downsample_size_.width()) && (idx_x >= 0) )
+				uint64_t bytes = (uint64_t)(x1 - x0) * (y1 - y0) * RGB_CHANNELS;
+				for (const auto& tile : area_tiles) {
+					const auto& entry = entries[tile.configuration][tile.index];
+					auto tile_size = outputTileSize(configurations[tile.configuration]);
+					bytes += (uint64_t)(entry.width * entry.height + tile_size * tile_size) * RGB_CHANNELS;
+				}
+				memory = std::make_shared<TileScheduler::MemoryReservation>(*scheduler_, bytes);
+
+				TileScheduler::IoSlot io(*scheduler_);
+				source = compositor->getImage(first.level, Rect(sedeen::Point(x0, y0), Size(x1 - x0, y1 - y0)));
+			}
+
+			for (const auto& tile : area_tiles) {
+				const auto k = tile.configuration;
+				const auto& entry = entries[k][tile.index];
+				auto tile_size = outputTileSize(configurations[k]);
+				image::RawImage tile_image;
+				if (whole_area)
 				{
-					if (askedToStop()) break;
-					sum += update_image.at(idx_x, idx_y, 0).as<double>();
-					idx_x++;
+					tile_image = reduceImage(cropImage(source, entry.x - x0, entry.y - y0, 
+						entry.width, entry.height), tile_size, tile_size);
 				}
-				idx_y++;
+				else
+				{
+					memory.reset();
+					memory = std::make_shared<TileScheduler::MemoryReservation>(*scheduler_,
+						(uint64_t)(entry.width * entry.height + 2 * tile_size * tile_size) * RGB_CHANNELS);
+					TileScheduler::IoSlot io(*scheduler_);
+					tile_image = readTile(*compositor, configurations[k], entry);
+				}
+
+				storeTilePixels(tile_image, tile_size, entry, tile.index, tensors[k].get(),
+					compute_stats ? &stats[k][tile.index] : nullptr, pixels);
+				writer.write(tile_image, tileFileName(sweepBaseName(k), configurations[k], entry),
+					memory);
 			}
+		}
+	});
+	writer.finish();
 
-			double box_area_scaled = (double)box_width_*box_width_*scale_;
-			if( sum/box_area_scaled > (double)threshold_)
+	for (size_t k = 0; k < configurations.size(); ++k)
+	{
+		writeManifest(sweepBaseName(k), configurations[k], entries[k], stats[k]);
+		writeIndex(sweepBaseName(k), configurations[k], entries[k], tensors[k].get());
+
+		tiles_.clear();
+		for (const auto& entry : entries[k])
+			addTileGraphic(configurations[k], entry);
+		SaveToXMLFile(sweepBaseName(k) + "_session.xml");
+	}
+}
+
+std::vector<TilePlanHeader> TileExtraction::readSweepConfigurations()
+{
+	sedeen::algorithm::parameter::OpenFileDialog::DataType openFileDialogDataType = sweep_file_;
+	if (!sweep_file_.isUserDefined() || openFileDialogDataType.empty())
+	{
+		throw std::runtime_error("Please select a sweep configuration file!");
+	}
+
+	auto path = openFileDialogDataType.front().getFilename();
+	std::ifstream file(path);
+	if (!file)
+		throw std::runtime_error("Unable to open the sweep configuration file: " + path);
+
+	std::vector<TilePlanHeader> configurations;
+	std::string line;
+	while (std::getline(file, line)) {
+		// Skip blank lines and comments
+		auto start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || '#' == line[start])
+			continue;
+
+		TilePlanHeader header = currentPlanHeader();
+		std::string resolution;
+		std::istringstream ss(line);
+		if (!(ss >> header.box_width >> header.box_spacing >> header.x_offset 
+			>> header.y_offset >> resolution) || header.box_width <= 0 || header.box_spacing <= 0)
+		{
+			throw std::runtime_error("Invalid sweep configuration: " + line);
+		}
+
+		auto found = std::find(ResolutionList_.begin(), ResolutionList_.end(), resolution);
+		if (found == ResolutionList_.end())
+			throw std::runtime_error("Resolution " + resolution + " is not available for this image");
+		header.level = (int)(found - ResolutionList_.begin());
+		configurations.push_back(header);
+	}
+
+	if (configurations.empty())
+		throw std::runtime_error("The sweep configuration file is empty: " + path);
+	return configurations;
+}
+
+std::vector<AnnotationPolygon> TileExtraction::readAnnotations()
+{
+	if (!(int)region_option_)
+		return std::vector<AnnotationPolygon>();
+
+	// The session written by this plugin only holds its own tiles
+	auto session = annotationFileName();
+	if (session == m_roi_file_name + "_session.xml")
+		throw std::runtime_error("The annotation session is the tile session written by this plugin: " + session);
+	auto polygons = readSessionPolygons(session);
+	if (polygons.empty())
+		throw std::runtime_error("No annotation regions were found in " + session);
+	return polygons;
+}
+
+std::string TileExtraction::annotationFileName()
+{
+	if (annotation_file_.isUserDefined())
+	{
+		sedeen::algorithm::parameter::OpenFileDialog::DataType openFileDialogDataType = annotation_file_;
+		if (!openFileDialogDataType.empty() && !openFileDialogDataType.front().getFilename().empty())
+			return openFileDialogDataType.front().getFilename();
+	}
+
+	std::string path_to_image = 
+		image()->getMetaData()->get(image::StringTags::SOURCE_DESCRIPTION, 0);
+	return path_to_image.substr(0, path_to_image.find_last_of(".")) + ".session.xml";
+}
+
+void TileExtraction::filterTileQuality(const TilePlanHeader& header,
+                                       std::vector<TilePlanEntry>& entries)
+{
+	using namespace image::tile;
+
+	// Use the coarsest level at which a tile is still large enough to measure,
+	// but never a finer level than the export reads from
+	int level = sourceLevel(header.level);
+	double level_scale = (double)getDimensions(image(), level).width() / header.image_width;
+	for (int l = getNumResolutionLevels(image()) - 1; l > level; --l) {
+		double scale = (double)getDimensions(image(), l).width() / header.image_width;
+		if (header.box_width * scale >= QUALITY_TILE_SIZE)
+		{
+			level = l;
+			level_scale = scale;
+			break;
+		}
+	}
+	int tile_size = std::max(1, (int)(header.box_width * level_scale));
+
+	const double min_sharpness = min_sharpness_;
+	const double max_pen_fraction = max_pen_fraction_;
+	const double max_dark_fraction = max_dark_fraction_;
+	std::vector<char> rejected(entries.size(), 0);
+	runChunks(*scheduler_, entries.size(), TILES_PER_CHUNK, [&](size_t begin, size_t end) {
+		auto compositor = std::unique_ptr<Compositor>(new Compositor(image()->getFactory()));
+		std::vector<uint8_t> pixels((size_t)tile_size * tile_size * RGB_CHANNELS);
+		for (size_t i = begin; i < end; ++i) {
+			if (askedToStop()) break;
+			PointF top_left = tileOrigin(header, entries[i]);
+			Rect tile = Rect(sedeen::Point((int)(top_left.getX() * level_scale),
+				(int)(top_left.getY() * level_scale)), Size(tile_size, tile_size));
+			image::RawImage coarse;
 			{
-				auto graphic_style = GraphicStyle();
-				results_.drawRectangle(Rectangle(top_left, bottom_right, 0, sedeen::Center),
-					graphic_style,
-					"Name", "Description");
+				TileScheduler::IoSlot io(*scheduler_);
+				coarse = compositor->getImage(level, tile);
+			}
 
-				if(top_left.getX() < image_size.width() && top_left.getY() < image_size.height() 
-					&& bottom_right.getX() < image_size.width() && bottom_right.getY() < image_size.height() )
-				{
-					// Get tills from the current output image
-					//auto source_region = image()->getFactory()->getLevelRegion(selectedResolution);
-					auto source_factory = image()->getFactory();
-					auto compositor = std::unique_ptr<Compositor>(new Compositor(source_factory));
-					Size tileSize = Size((int)box_width_, (int)box_width_);
-					Size downsample_size = tileSize;
-					if(selectedResolution)
-					{
-						downsample_size = Size((int)box_width_/(std::pow(scaleResolution_, selectedResolution)), 
-							(int)box_width_/(std::pow(scaleResolution_, selectedResolution)));
-					}
-					/*Rect tile = Rect(sedeen::Point(x_offset_ + x * box_spacing_,
-						y_offset_ + y * box_spacing_), tileSize);	
-					image::RawImage imageResolution = compositor->getImage(tile, downsample_size);*/
-
-					sedeen::Point top_left_selectedRes = sedeen::Point(top_left.getX()*scale_x, 
-						top_left.getY()*scale_y);
-					sedeen::Point bottom_right_selectedRes = sedeen::Point(bottom_right.getX()*scale_x, 
-						bottom_right.getY()*scale_y);
-
-				
-					Rect tile = Rect(top_left_selectedRes, downsample_size);
-					image::RawImage imageResolution = compositor->getImage(selectedResolution, tile);					
-				
-					if((int)save_option_)
-					{
-						//auto extensionList = fileDialogOptions_.selectedFilter;
-						auto p = m_roi_file_name.find_last_of('.');
-						std::string base_name;
-						p >0 && p != std::string::npos ? base_name = m_roi_file_name.substr(0, m_roi_file_name.rfind(".")) : 
-																	 m_roi_file_name = m_roi_file_name;
-						std::string extension =  m_roi_file_name.substr(m_roi_file_name.rfind("."));
-						imageResolution.save(base_name + "_" + std::to_string((int)(top_left.getX()+ box_width_/2)) + "_" 
-							+ std::to_string((int)(top_left.getY()+ box_width_/2)) + "_" 
-							+ ResolutionList_.at(selectedResolution) + extension); //std::to_string(selectedResolution)
-
-						//XML file
-						GraphicInfo roi_info;
-						roi_info.red = 181;
-						roi_info.green = 230;
-						roi_info.blue = 29;
-						roi_info.region = "Region " + std::to_string(num_tiles++);
-						roi_info.style = graphic_style;
-						roi_info.description = " ";
-						roi_info.type = "rectangle";
-						std::vector<PointF> points;
-						roi_info.points.push_back(top_left);
-						roi_info.points.push_back(PointF(bottom_right.getX(), top_left.getY()));
-						roi_info.points.push_back(bottom_right);
-						roi_info.points.push_back(PointF(top_left.getX(), bottom_right.getY()));
-						tiles_.push_back(roi_info);
-					}
-
-				}			
+			std::fill(pixels.begin(), pixels.end(), 0);
+			copyPixels(coarse, tile_size, tile_size, RGB_CHANNELS, pixels.data());
+			auto quality = measureTileQuality(pixels.data(), tile_size, tile_size);
+			rejected[i] = quality.sharpness < min_sharpness ||
+				quality.pen_fraction > max_pen_fraction ||
+				quality.dark_fraction > max_dark_fraction;
+		}
+	});
+
+	size_t kept = 0;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		if (!rejected[i])
+			entries[kept++] = entries[i];
+	}
+	entries.resize(kept);
+}
 
+void TileExtraction::exportTiles(const TilePlanHeader& header,
+                                 const std::vector<TilePlanEntry>& entries)
+{
+	using namespace image::tile;
+	if (entries.empty())
+		return;
+
+	// All tiles of a run share the size of the selected resolution
+	const int tile_size = outputTileSize(header);
+	std::unique_ptr<TileTensorWriter> tensor;
+	if ((int)tensor_option_)
+	{
+		tensor.reset(new TileTensorWriter(tileBaseName() + "_tiles", entries.size(),
+			tile_size, tile_size, RGB_CHANNELS));
+	}
+
+	bool compute_stats = 0 != (int)stats_option_;
+	std::vector<ColorStatistics> stats(compute_stats ? entries.size() : 0);
+
+	// Reading the next tiles overlaps with saving the previous ones
+	TileWriter writer(*scheduler_, (TileWriter::Durability)(int)durability_option_);
+	runChunks(*scheduler_, entries.size(), TILES_PER_CHUNK, [&](size_t begin, size_t end) {
+		auto compositor = std::unique_ptr<Compositor>(new Compositor(image()->getFactory()));
+		std::vector<uint8_t> pixels;
+		for (size_t i = begin; i < end; ++i) {
+			if (askedToStop()) break;
+			const auto& entry = entries[i];
+			// The reservation stays with the tile until it is saved
+			auto memory = std::make_shared<TileScheduler::MemoryReservation>(*scheduler_,
+				(uint64_t)(entry.width * entry.height + 2 * tile_size * tile_size) * RGB_CHANNELS);
+			image::RawImage imageResolution;
+			{
+				TileScheduler::IoSlot io(*scheduler_);
+				imageResolution = readTile(*compositor, header, entry);
 			}
+
+			storeTilePixels(imageResolution, tile_size, entry, i, tensor.get(),
+				compute_stats ? &stats[i] : nullptr, pixels);
+			writer.write(imageResolution, tileFileName(tileBaseName(), header, entry), memory);
+		}
+	});
+	writer.finish();
+
+	writeManifest(tileBaseName(), header, entries, stats);
+	writeIndex(tileBaseName(), header, entries, tensor.get());
+}
+
+void TileExtraction::writeManifest(const std::string& base_name,
+                                   const TilePlanHeader& header,
+                                   const std::vector<TilePlanEntry>& entries,
+                                   const std::vector<ColorStatistics>& stats)
+{
+	std::ofstream manifest(base_name + "_manifest.csv");
+	manifest << "file,grid_x,grid_y,centre_x,centre_y,level,x,y,width,height,score";
+	if (!stats.empty())
+	{
+		manifest << ",";
+		ColorStatistics::writeSummaryHeader(manifest);
+	}
+	manifest << "\n";
+
+	ColorStatistics slide_stats;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const auto& entry = entries[i];
+		PointF top_left = tileOrigin(header, entry);
+		auto file_name = tileFileName(base_name, header, entry);
+		manifest << file_name.substr(file_name.find_last_of("/\\") + 1) << ","
+			<< entry.grid_x << "," << entry.grid_y << ","
+			<< (int)(top_left.getX() + header.box_width/2) << ","
+			<< (int)(top_left.getY() + header.box_width/2) << ","
+			<< entry.level << "," << entry.x << "," << entry.y << ","
+			<< entry.width << "," << entry.height << "," << entry.score;
+		if (!stats.empty())
+		{
+			manifest << ",";
+			stats[i].writeSummary(manifest);
+			slide_stats.merge(stats[i]);
 		}
+		manifest << "\n";
+	}
+
+	// Raw sums of the slide, so that slides can be merged by adding rows
+	if (!stats.empty())
+	{
+		std::ofstream slide_file(base_name + "_color_stats.csv");
+		slide_file << "slide,";
+		ColorStatistics::writeSumsHeader(slide_file);
+		slide_file << ",";
+		ColorStatistics::writeSummaryHeader(slide_file);
+		slide_file << "\n";
+		slide_file << image()->getMetaData()->get(image::StringTags::SOURCE_DESCRIPTION, 0) << ",";
+		slide_stats.writeSums(slide_file);
+		slide_file << ",";
+		slide_stats.writeSummary(slide_file);
+		slide_file << "\n";
+	}
+}
+
+void TileExtraction::writeIndex(const std::string& base_name,
+                                const TilePlanHeader& header,
+                                const std::vector<TilePlanEntry>& entries,
+                                const TileTensorWriter* tensor)
+{
+	const int tile_size = outputTileSize(header);
+	TileIndexHeader index_header = { 0, 0, header.box_width, header.box_spacing,
+		tile_size, tile_size, header.level, 0 };
+
+	std::vector<TileIndexEntry> rows(entries.size());
+	std::vector<std::string> names(entries.size());
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const auto& entry = entries[i];
+		PointF top_left = tileOrigin(header, entry);
+		auto file_name = tileFileName(base_name, header, entry);
+		TileIndexEntry row = { entry.grid_x, entry.grid_y,
+			(int32_t)top_left.getX(), (int32_t)top_left.getY(),
+			header.box_width, header.box_width, entry.level, entry.score, 0, 0,
+			tileFileSize(file_name), tensor ? tensor->tileOffset(i) : NO_TENSOR_OFFSET };
+		rows[i] = row;
+		names[i] = file_name.substr(file_name.find_last_of("/\\") + 1);
+	}
+
+	writeTileIndex(base_name + "_index.bin", index_header, rows, names);
+}
+
+std::string TileExtraction::tileFileName(const std::string& base_name,
+                                         const TilePlanHeader& header,
+                                         const TilePlanEntry& entry) const
+{
+	PointF top_left = tileOrigin(header, entry);
+	return base_name + "_" + std::to_string((int)(top_left.getX()+ header.box_width/2)) + "_" 
+		+ std::to_string((int)(top_left.getY()+ header.box_width/2)) + "_" 
+		+ ResolutionList_.at(header.level) + tileExtension();
+}
+
+TilePlanEstimate TileExtraction::calibrateCost(const TilePlanHeader& header,
+                                               const std::vector<TilePlanEntry>& entries)
+{
+	using namespace image::tile;
+	typedef std::chrono::steady_clock Clock;
+
+	// Number of tiles read and encoded to calibrate the estimate
+	const int MAX_SAMPLES = 8;
+
+	TilePlanEstimate estimate;
+	estimate.tile_count = entries.size();
+	estimate.sample_count = (int)std::min<size_t>(MAX_SAMPLES, entries.size());
+	estimate.read_seconds_per_tile = 0.0;
+
+	// Samples are timed one at a time, the export runs tiles in parallel
+	estimate.parallel_tiles = scheduler_->concurrency();
+	for (auto extension : {".tif", ".jpg", ".png", ".bmp"}) {
+		TileCodecCost codec = { extension, 0.0, 0.0 };
+		estimate.codecs.push_back(codec);
+	}
+	if (0 == estimate.sample_count)
+		return estimate;
+
+	auto compositor = std::unique_ptr<Compositor>(new Compositor(image()->getFactory()));
+	auto calibration_name = tileBaseName() + "_calibration";
+	for (int i = 0; i < estimate.sample_count; ++i) {
+		if (askedToStop()) break;
+		const auto& entry = entries[i * entries.size() / estimate.sample_count];
+
+		// Samples hold an I/O slot like the export, so the wait for a slot
+		// is part of the measured cost
+		TileScheduler::MemoryReservation memory(*scheduler_,
+			(uint64_t)(entry.width * entry.height + outputTileSize(header) * outputTileSize(header)) * RGB_CHANNELS);
+		auto start = Clock::now();
+		image::RawImage sample;
+		{
+			TileScheduler::IoSlot io(*scheduler_);
+			sample = readTile(*compositor, header, entry);
+		}
+		estimate.read_seconds_per_tile += 
+			std::chrono::duration<double>(Clock::now() - start).count();
+
+		for (auto& codec : estimate.codecs) {
+			auto path = calibration_name + codec.extension;
+			start = Clock::now();
+			TileScheduler::IoSlot io(*scheduler_);
+			sample.save(path);
+			codec.seconds_per_tile += 
+				std::chrono::duration<double>(Clock::now() - start).count();
+
+			std::ifstream file(path, std::ios::binary | std::ios::ate);
+			codec.bytes_per_tile += (double)file.tellg();
+			file.close();
+			std::remove(path.c_str());
+		}
+	}
+
+	estimate.read_seconds_per_tile /= estimate.sample_count;
+	for (auto& codec : estimate.codecs) {
+		codec.bytes_per_tile /= estimate.sample_count;
+		codec.seconds_per_tile /= estimate.sample_count;
 	}
+	return estimate;
+}
+
+TilePlanHeader TileExtraction::currentPlanHeader()
+{
+	auto image_size = getDimensions(image(), 0);
+	TilePlanHeader header;
+	header.image_width = image_size.width();
+	header.image_height = image_size.height();
+	header.box_width = box_width_;
+	header.box_spacing = box_spacing_;
+	header.x_offset = x_offset_;
+	header.y_offset = y_offset_;
+	header.level = getSelectedResolution();
+	header.threshold = (float)(double)threshold_;
+	return header;
+}
+
+PointF TileExtraction::tileOrigin(const TilePlanHeader& header, const TilePlanEntry& entry) const
+{
+	return PointF(header.x_offset + entry.grid_x * header.box_spacing,
+		header.y_offset + entry.grid_y * header.box_spacing);
+}
+
+bool TileExtraction::isInsideImage(const TilePlanHeader& header, const TilePlanEntry& entry) const
+{
+	PointF top_left = tileOrigin(header, entry);
+	return top_left.getX() + header.box_width < header.image_width &&
+		top_left.getY() + header.box_width < header.image_height;
+}
+
+image::RawImage TileExtraction::readTile(image::tile::Compositor& compositor,
+                                         const TilePlanHeader& header,
+                                         const TilePlanEntry& entry) const
+{
+	Rect tile = Rect(sedeen::Point(entry.x, entry.y), Size(entry.width, entry.height));
+	auto tile_size = outputTileSize(header);
+	return reduceImage(compositor.getImage(entry.level, tile), tile_size, tile_size);
+}
+
+int TileExtraction::sourceLevel(int resolution) const
+{
+	// Each entry of the resolution list halves the magnification
+	const double factor = std::pow(2.0, resolution);
+	const double full_width = getDimensions(image(), 0).width();
+
+	// Levels are ordered from the finest to the coarsest; allow for the
+	// rounding of the level dimensions
+	int level = 0;
+	for (int l = 1; l < getNumResolutionLevels(image()); ++l) {
+		double downsample = full_width / getDimensions(image(), l).width();
+		if (downsample <= factor * 1.01)
+			level = l;
+	}
+	return level;
+}
+
+int TileExtraction::outputTileSize(const TilePlanHeader& header) const
+{
+	return std::max(1, (int)(header.box_width / std::pow(2.0, header.level)));
+}
+
+int TileExtraction::getSelectedResolution()
+{
+	int selectedResolution =0;
+	if(ResolutionLevel_.isUserDefined())
+	{
+		selectedResolution = (int)ResolutionLevel_;
+	}
+	return selectedResolution;
+}
+
+std::string TileExtraction::tileBaseName() const
+{
+	auto p = m_roi_file_name.find_last_of('.');
+	if (p > 0 && p != std::string::npos)
+		return m_roi_file_name.substr(0, p);
+	return m_roi_file_name;
+}
+
+std::string TileExtraction::tileExtension() const
+{
+	auto p = m_roi_file_name.find_last_of('.');
+	if (p > 0 && p != std::string::npos)
+		return m_roi_file_name.substr(p);
+	return ".tif";
+}
+
+std::string TileExtraction::planFileName() const
+{
+	return tileBaseName() + "_tileplan.bin";
 }
 
 std::string TileExtraction::openFile(std::string path)
@@ -36,6 +36,12 @@
 #include "algorithm\Parameters.h"
 #include "algorithm\Results.h"
 
+#include "AnnotationIndex.h"
+#include "ColorStatistics.h"
+#include "SlideHistogram.h"
+#include "TilePlan.h"
+#include "TileQuality.h"
+
 namespace sedeen {
 
 namespace image {
@@ -46,6 +52,7 @@ namespace tile {
 
 class ChannelSelect;
 class Closing;
+class Compositor;
 class FilterFactory;
 class Opening;
 class Threshold;
@@ -56,6 +63,8 @@ class Threshold;
 
 namespace algorithm {
 
+class TileScheduler;
+class TileTensorWriter;
 
 /// A uniform sampling utility based on principles of stereology 
 //
@@ -77,9 +86,10 @@ class TileExtraction : public AlgorithmBase {
 
   virtual void init(const image::ImageHandle& image);
 
-  /// Determines the optimal threshold using Otsu's method
+  /// Determines the optimal threshold with the selected threshold method
   //
-  /// Updates the intermediate member \c channel_factory_
+  /// Computes the slide histograms on the first call and reuses them for any
+  /// later channel or method
   int getOptimalThreshold();
 
   /// Check if the parameters have changed since the last invocation.
@@ -104,7 +114,145 @@ class TileExtraction : public AlgorithmBase {
   void updateIntermediateResult();
 
   void drawTileBox();
-  void SaveToXMLFile();
+
+  /// Writes the tiles in \c tiles_ as rectangles of a Sedeen session
+  void SaveToXMLFile(const std::string& file_name);
+
+  /// Adds the rectangle of the tile described by \c entry to \c tiles_
+  void addTileGraphic(const TilePlanHeader& header, const TilePlanEntry& entry);
+
+  /// Runs only the tissue scoring stage and writes the resulting tile plan
+  //
+  /// The plan is written next to the tiles together with a report of the
+  /// expected tile count, storage and run time for each output format.
+  void planTiles();
+
+  /// Summed-area table of the down-sampled tissue mask
+  struct MaskIntegral {
+    /// (width + 1) x (height + 1) running sums, row-major, with a leading
+    /// row and column of zeros
+    std::vector<double> sums;
+
+    /// Largest value of the mask, i.e. the value of a tissue pixel
+    double max_value;
+  };
+
+  /// Computes the summed-area table of the down-sampled tissue mask
+  MaskIntegral computeMaskIntegral();
+
+  /// Scores every cell of the sampling grid against the tissue mask
+  //
+  /// \param annotation_polygons
+  /// Regions the cells must lie in, or empty to use the whole slide
+  /// \return
+  /// The cells whose tissue score exceeds the threshold parameter; each
+  /// entry holds the fraction of its mask pixels that are tissue
+  std::vector<TilePlanEntry> scoreTiles(const TilePlanHeader& header,
+                                        const MaskIntegral& mask,
+                                        const std::vector<AnnotationPolygon>& annotation_polygons);
+
+  /// Runs every configuration of the sweep file in one pass
+  //
+  /// The mask is scored once, and each source area is read once and cut into
+  /// the tiles of all the configurations overlapping it.
+  void sweepTiles();
+
+  /// Reads the grid parameters of each line of the sweep file
+  std::vector<TilePlanHeader> readSweepConfigurations();
+
+  /// Reads the annotation regions if "Region" is set to the annotations
+  //
+  /// \return
+  /// The regions, or none when the whole slide is used
+  /// \throws std::runtime_error if the session holds no region
+  std::vector<AnnotationPolygon> readAnnotations();
+
+  /// Path of the session XML holding the annotation regions
+  //
+  /// Defaults to the session Sedeen saves next to the image when no file has
+  /// been selected.
+  std::string annotationFileName();
+
+  /// Removes the tiles that fail the quality filter from \c entries
+  //
+  /// Each tile is measured on a coarse pyramid level, so rejected tiles never
+  /// cost a full resolution read.
+  void filterTileQuality(const TilePlanHeader& header,
+                         std::vector<TilePlanEntry>& entries);
+
+  /// Reads the tiles of \c entries and writes them to the selected outputs
+  //
+  /// Tiles are read by a pool of worker threads, each tile is saved as an
+  /// image file and, if enabled, copied into the tensor export.
+  void exportTiles(const TilePlanHeader& header,
+                   const std::vector<TilePlanEntry>& entries);
+
+  /// Writes the tile manifest, and the slide colour statistics if computed
+  //
+  /// \param stats
+  /// Colour statistics of each tile of \c entries, or empty if they were not
+  /// computed
+  void writeManifest(const std::string& base_name,
+                     const TilePlanHeader& header,
+                     const std::vector<TilePlanEntry>& entries,
+                     const std::vector<ColorStatistics>& stats);
+
+  /// Writes the binary tile index of an export
+  //
+  /// \param tensor
+  /// Tensor export the tiles were copied into, or null if there is none
+  void writeIndex(const std::string& base_name,
+                  const TilePlanHeader& header,
+                  const std::vector<TilePlanEntry>& entries,
+                  const TileTensorWriter* tensor);
+
+  /// File name of the image saved for the tile described by \c entry
+  std::string tileFileName(const std::string& base_name,
+                           const TilePlanHeader& header,
+                           const TilePlanEntry& entry) const;
+
+  /// Measures read and encode cost on a few tiles of \c entries
+  TilePlanEstimate calibrateCost(const TilePlanHeader& header,
+                                 const std::vector<TilePlanEntry>& entries);
+
+  /// Reads the tile of \c entry at the resolution selected in \c header
+  //
+  /// The tile is read from its source level and, if that level is finer than
+  /// the selected resolution, reduced with reduceRgb().
+  image::RawImage readTile(image::tile::Compositor& compositor,
+                           const TilePlanHeader& header,
+                           const TilePlanEntry& entry) const;
+
+  /// The stored pyramid level tiles of a resolution are read from
+  //
+  /// \return
+  /// The coarsest level whose down-sampling does not exceed that of
+  /// \c resolution, an index into \c ResolutionList_
+  int sourceLevel(int resolution) const;
+
+  /// Width and height, in pixels, of the saved tiles
+  int outputTileSize(const TilePlanHeader& header) const;
+
+  /// Grid parameters of the current parameter values
+  TilePlanHeader currentPlanHeader();
+
+  /// Top-left corner of a tile, in full resolution coordinates
+  PointF tileOrigin(const TilePlanHeader& header, const TilePlanEntry& entry) const;
+
+  /// Check if a tile lies entirely within the full resolution image
+  bool isInsideImage(const TilePlanHeader& header, const TilePlanEntry& entry) const;
+
+  /// The resolution level selected for saving the tiles
+  int getSelectedResolution();
+
+  /// Output file name without its extension
+  std::string tileBaseName() const;
+
+  /// Extension of the output file name, including the leading dot
+  std::string tileExtension() const;
+
+  /// Path of the tile plan written by planTiles()
+  std::string planFileName() const;
 
    bool contains(const PointF& topLeft, const PointF& bottomRight, Size& rect_size) const;
 
@@ -141,6 +289,15 @@ class TileExtraction : public AlgorithmBase {
   /// Parameter for selection of image component
   int channel_index_;
 
+  /// Per-channel histograms of the down-sampled image
+  std::unique_ptr<SlideHistogram> slide_histogram_;
+
+  /// Parameter for selecting the method deriving the optimal threshold
+  OptionParameter threshold_method_;
+
+  /// Worker pool shared with the other slides processed in the process
+  std::shared_ptr<TileScheduler> scheduler_;
+
    /// Parameter for selecting threshold retainment
  // image::tile::Threshold::Behavior behavior_;
 
@@ -167,6 +324,53 @@ class TileExtraction : public AlgorithmBase {
 
   SaveFileDialogParameter saveFileDialogParam_;
 
+  /// Options of the mode parameter
+  enum Mode {
+    EXTRACT_TILES = 0,
+    PLAN_TILES,
+    EXTRACT_FROM_PLAN,
+    SWEEP_CONFIGURATIONS
+  };
+
+  /// Parameter for selecting whether to extract, plan, or execute a plan
+  OptionParameter mode_;
+
+  /// Text file listing the configurations of a sweep, one per line
+  OpenFileDialogParameter sweep_file_;
+
+  /// Parameter for selecting to also write the tiles into a .npy array
+  OptionParameter tensor_option_;
+
+  /// Parameter for selecting when saved tiles are flushed to disk
+  OptionParameter durability_option_;
+
+  /// Parameter for selecting to compute per-tile colour statistics
+  OptionParameter stats_option_;
+
+  /// Parameter for selecting to reject blurry, pen-marked or folded tiles
+  OptionParameter quality_option_;
+
+  /// Minimum variance of the Laplacian of a tile at the coarse level
+  DoubleParameter min_sharpness_;
+
+  /// Maximum fraction of pen ink pixels in a tile
+  DoubleParameter max_pen_fraction_;
+
+  /// Maximum fraction of dark (folded) pixels in a tile
+  DoubleParameter max_dark_fraction_;
+
+  /// Parameter for selecting to restrict the tiles to annotated regions
+  OptionParameter region_option_;
+
+  /// Session XML holding the annotation regions
+  OpenFileDialogParameter annotation_file_;
+
+  /// Minimum fraction of a tile that must lie inside the annotations
+  DoubleParameter min_coverage_;
+
+  /// Text result reporter through which plan estimates are displayed
+  TextResult output_text_;
+
    /// The intermediate image factory after channel selection 
   std::shared_ptr<image::tile::Factory> channel_factory_;
 
@@ -192,7 +396,6 @@ class TileExtraction : public AlgorithmBase {
   };
 
   std::vector<GraphicInfo> tiles_;
-  double scaleResolution_;
 
 };
 
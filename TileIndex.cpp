@@ -0,0 +1,88 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#include "TileIndex.h"
+
+// System headers
+#include <Windows.h>
+#include <fstream>
+#include <stdexcept>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+// Identifies an index file and its layout version
+const char INDEX_MAGIC[8] = {'T', 'E', 'T', 'I', 'D', 'X', '0', '1'};
+
+static_assert(sizeof(TileIndexHeader) == 40, "TileIndexHeader must be packed");
+static_assert(sizeof(TileIndexEntry) == 56, "TileIndexEntry must be packed");
+
+} // namespace
+
+void writeTileIndex(const std::string& path, TileIndexHeader header,
+                    std::vector<TileIndexEntry>& entries,
+                    const std::vector<std::string>& names) {
+	if (names.size() != entries.size())
+		throw std::invalid_argument("Every tile of the index needs a file name");
+
+	std::string name_table;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		entries[i].name_offset = static_cast<uint32_t>(name_table.size());
+		entries[i].name_length = static_cast<uint32_t>(names[i].size());
+		name_table += names[i];
+	}
+
+	header.count = entries.size();
+	header.names_offset = sizeof(INDEX_MAGIC) + sizeof(header) +
+		entries.size() * sizeof(TileIndexEntry);
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		throw std::runtime_error("Unable to write the tile index: " + path);
+
+	file.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!entries.empty())
+		file.write(reinterpret_cast<const char*>(entries.data()),
+			entries.size() * sizeof(TileIndexEntry));
+	file.write(name_table.data(), name_table.size());
+
+	if (!file)
+		throw std::runtime_error("Unable to write the tile index: " + path);
+}
+
+uint64_t tileFileSize(const std::string& path) {
+	// Reads the size from the directory entry, without opening the file
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes))
+		return 0;
+	return (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) |
+		attributes.nFileSizeLow;
+}
+
+} // namespace algorithm
+} // namespace sedeen
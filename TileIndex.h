@@ -0,0 +1,113 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_TILEEXTRACTION_TILEINDEX_H
+#define SEDEEN_SRC_TILEEXTRACTION_TILEINDEX_H
+
+// System headers
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+/// Grid parameters shared by all the tiles of an index
+//
+/// Follows the 8-byte magic at the start of the index file; the rows start
+/// right after it, at byte 48.
+struct TileIndexHeader {
+  /// Number of rows
+  uint64_t count;
+
+  /// Byte offset of the name table from the start of the file
+  uint64_t names_offset;
+
+  /// Size and spacing of the grid cells, at full resolution
+  int32_t box_width;
+  int32_t box_spacing;
+
+  /// Size of an exported tile, in pixels
+  int32_t tile_width;
+  int32_t tile_height;
+
+  /// Selected resolution, each step halving the full resolution
+  int32_t resolution;
+
+  /// Unused, keeps the header 8-byte aligned
+  int32_t reserved;
+};
+
+/// One exported tile
+//
+/// Rows are fixed-width so that the index can be memory-mapped and filtered
+/// by score or region without parsing.
+struct TileIndexEntry {
+  /// Column and row of the cell in the sampling grid
+  int32_t grid_x;
+  int32_t grid_y;
+
+  /// Tile rectangle, in full resolution pixel coordinates
+  int32_t x;
+  int32_t y;
+  int32_t width;
+  int32_t height;
+
+  /// Pyramid level the tile was read from
+  int32_t level;
+
+  /// Fraction of the cell's mask pixels that are tissue, in [0, 1]
+  float score;
+
+  /// File name of the tile, as a byte range of the name table
+  uint32_t name_offset;
+  uint32_t name_length;
+
+  /// Size of the tile file, in bytes; 0 if it could not be found
+  uint64_t file_size;
+
+  /// Byte offset of the tile's pixels in the tensor export, or
+  /// NO_TENSOR_OFFSET when the tiles were not exported as a tensor
+  uint64_t tensor_offset;
+};
+
+/// Tensor offset of a tile that is not part of a tensor export
+const uint64_t NO_TENSOR_OFFSET = ~0ull;
+
+/// Writes the index to \a path
+//
+/// \a names holds the file name of each row. The name ranges of \a entries
+/// are filled in by this function.
+/// \throws std::runtime_error if the file cannot be written
+void writeTileIndex(const std::string& path, TileIndexHeader header,
+                    std::vector<TileIndexEntry>& entries,
+                    const std::vector<std::string>& names);
+
+/// Size of the file at \a path, in bytes, or 0 if it does not exist
+uint64_t tileFileSize(const std::string& path);
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif
@@ -0,0 +1,142 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#include "TilePlan.h"
+
+// System headers
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+// Identifies a plan file and its layout version
+const char PLAN_MAGIC[8] = {'T', 'E', 'P', 'L', 'A', 'N', '0', '1'};
+
+static_assert(sizeof(TilePlanEntry) == 32, "TilePlanEntry must be packed");
+static_assert(sizeof(TilePlanHeader) == 32, "TilePlanHeader must be packed");
+
+std::string formatBytes(double bytes) {
+	const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+	int unit = 0;
+	while (bytes >= 1024.0 && unit < 4) {
+		bytes /= 1024.0;
+		++unit;
+	}
+	std::ostringstream ss;
+	ss << std::fixed << std::setprecision(unit ? 2 : 0) << bytes << " " << units[unit];
+	return ss.str();
+}
+
+std::string formatDuration(double seconds) {
+	auto total = static_cast<long long>(seconds + 0.5);
+	std::ostringstream ss;
+	ss << total / 3600 << "h "
+		<< std::setw(2) << std::setfill('0') << (total / 60) % 60 << "m "
+		<< std::setw(2) << std::setfill('0') << total % 60 << "s";
+	return ss.str();
+}
+
+} // namespace
+
+void writeTilePlan(const std::string& path, const TilePlanHeader& header,
+                   const std::vector<TilePlanEntry>& entries) {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		throw std::runtime_error("Unable to write the tile plan: " + path);
+
+	uint64_t count = entries.size();
+	file.write(PLAN_MAGIC, sizeof(PLAN_MAGIC));
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	if (count)
+		file.write(reinterpret_cast<const char*>(entries.data()),
+			count * sizeof(TilePlanEntry));
+
+	if (!file)
+		throw std::runtime_error("Unable to write the tile plan: " + path);
+}
+
+void readTilePlan(const std::string& path, TilePlanHeader& header,
+                  std::vector<TilePlanEntry>& entries) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Unable to open the tile plan: " + path);
+
+	char magic[sizeof(PLAN_MAGIC)];
+	uint64_t count = 0;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	file.read(reinterpret_cast<char*>(&count), sizeof(count));
+	if (!file || 0 != std::memcmp(magic, PLAN_MAGIC, sizeof(PLAN_MAGIC)))
+		throw std::runtime_error("Not a valid tile plan: " + path);
+
+	// Check the count against the file size before allocating the entries
+	auto data_start = file.tellg();
+	file.seekg(0, std::ios::end);
+	uint64_t available = static_cast<uint64_t>(file.tellg() - data_start);
+	file.seekg(data_start);
+	if (!file || count > available / sizeof(TilePlanEntry))
+		throw std::runtime_error("The tile plan is truncated: " + path);
+
+	entries.resize(count);
+	if (count)
+		file.read(reinterpret_cast<char*>(entries.data()),
+			count * sizeof(TilePlanEntry));
+
+	if (!file)
+		throw std::runtime_error("The tile plan is truncated: " + path);
+}
+
+std::string formatTilePlanEstimate(const TilePlanEstimate& estimate) {
+	std::ostringstream ss;
+	ss << "Tiles: " << estimate.tile_count << "\n";
+	if (0 == estimate.sample_count) {
+		ss << "No tiles were sampled; cost could not be estimated.\n";
+		return ss.str();
+	}
+
+	auto count = static_cast<double>(estimate.tile_count);
+	auto parallel = std::max(1, estimate.parallel_tiles);
+	ss << "Calibrated on " << estimate.sample_count << " sample tile(s), "
+		<< std::fixed << std::setprecision(1)
+		<< estimate.read_seconds_per_tile * 1000.0 << " ms read per tile, "
+		<< parallel << " tile(s) at a time\n";
+	for (const auto& codec : estimate.codecs) {
+		auto seconds = count * (estimate.read_seconds_per_tile + codec.seconds_per_tile) / parallel;
+		ss << codec.extension << ": "
+			<< formatBytes(count * codec.bytes_per_tile) << ", "
+			<< formatDuration(seconds) << "\n";
+	}
+	return ss.str();
+}
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,126 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_TILEEXTRACTION_TILEPLAN_H
+#define SEDEEN_SRC_TILEEXTRACTION_TILEPLAN_H
+
+// System headers
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+/// One grid cell accepted by the tissue scoring stage
+//
+/// The layout is fixed-width so that a plan can be written and read back as a
+/// flat array of records.
+struct TilePlanEntry {
+  /// Column of the cell in the sampling grid
+  int32_t grid_x;
+
+  /// Row of the cell in the sampling grid
+  int32_t grid_y;
+
+  /// Pyramid level the tile is read from
+  int32_t level;
+
+  /// Tile rectangle, in the pixel coordinates of \c level
+  int32_t x;
+  int32_t y;
+  int32_t width;
+  int32_t height;
+
+  /// Fraction of the cell's mask pixels that are tissue, in [0, 1]
+  float score;
+};
+
+/// Grid parameters a plan was produced with
+//
+/// Stored at the start of the plan file so that an execution run can verify
+/// the plan belongs to the open image and rebuild tile names from it.
+struct TilePlanHeader {
+  int32_t image_width;
+  int32_t image_height;
+  int32_t box_width;
+  int32_t box_spacing;
+  int32_t x_offset;
+  int32_t y_offset;
+
+  /// Selected resolution, each step halving the full resolution
+  int32_t level;
+
+  float threshold;
+};
+
+/// Measured cost of exporting a tile with one output format
+struct TileCodecCost {
+  /// Extension of the output format, e.g. ".tif"
+  std::string extension;
+
+  /// Average encoded size of a tile, in bytes
+  double bytes_per_tile;
+
+  /// Average time spent encoding and writing a tile, in seconds
+  double seconds_per_tile;
+};
+
+/// Cost estimate of executing a plan, extrapolated from a few sample tiles
+struct TilePlanEstimate {
+  /// Number of tiles in the plan
+  uint64_t tile_count;
+
+  /// Number of tiles that were read to calibrate the estimate
+  int sample_count;
+
+  /// Average time spent reading a tile from the slide, in seconds
+  double read_seconds_per_tile;
+
+  /// Number of tiles the export processes at the same time
+  int parallel_tiles;
+
+  /// Per-format encoding cost
+  std::vector<TileCodecCost> codecs;
+};
+
+/// Writes the plan to \a path
+//
+/// \throws std::runtime_error if the file cannot be written
+void writeTilePlan(const std::string& path, const TilePlanHeader& header,
+                   const std::vector<TilePlanEntry>& entries);
+
+/// Reads a plan previously written by writeTilePlan()
+//
+/// \throws std::runtime_error if the file cannot be read or is not a plan
+void readTilePlan(const std::string& path, TilePlanHeader& header,
+                  std::vector<TilePlanEntry>& entries);
+
+/// Formats \a estimate as a human-readable report
+std::string formatTilePlanEstimate(const TilePlanEstimate& estimate);
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif
@@ -0,0 +1,103 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#include "TileQuality.h"
+
+// System headers
+#include <algorithm>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+// Minimum HSV saturation (0-255) of pen ink
+const int PEN_MIN_SATURATION = 64;
+
+// Hue range, in degrees, of green and blue marker ink; H&E stains are pink
+// to purple and fall outside of it
+const int PEN_MIN_HUE = 75;
+const int PEN_MAX_HUE = 260;
+
+// Maximum HSV value (0-255) of a pixel counted as dark
+const int DARK_MAX_VALUE = 64;
+
+} // namespace
+
+TileQuality measureTileQuality(const uint8_t* rgb, int width, int height) {
+	TileQuality quality = { 0.0, 0.0, 0.0 };
+	auto count = static_cast<size_t>(width) * height;
+	if (0 == count)
+		return quality;
+
+	// Grey levels, using integer BT.601 weights
+	std::vector<int16_t> grey(count);
+	for (size_t p = 0; p < count; ++p)
+		grey[p] = static_cast<int16_t>(
+			(77 * rgb[3 * p] + 150 * rgb[3 * p + 1] + 29 * rgb[3 * p + 2]) >> 8);
+
+	// Variance of the 4-neighbour Laplacian over the interior pixels
+	int64_t sum = 0, sum_sq = 0;
+	for (int y = 1; y < height - 1; ++y) {
+		const int16_t* row = grey.data() + static_cast<size_t>(y) * width;
+		for (int x = 1; x < width - 1; ++x) {
+			int32_t lap = row[x - width] + row[x + width] + row[x - 1] + row[x + 1] - 4 * row[x];
+			sum += lap;
+			sum_sq += lap * lap;
+		}
+	}
+	auto interior = static_cast<double>(std::max(0, width - 2)) * std::max(0, height - 2);
+	if (interior > 0) {
+		double mean = sum / interior;
+		quality.sharpness = sum_sq / interior - mean * mean;
+	}
+
+	// Pen ink and dark pixels, from HSV value, saturation and hue
+	size_t pen = 0, dark = 0;
+	for (size_t p = 0; p < count; ++p) {
+		int r = rgb[3 * p], g = rgb[3 * p + 1], b = rgb[3 * p + 2];
+		int max = std::max(r, std::max(g, b));
+		int min = std::min(r, std::min(g, b));
+		int delta = max - min;
+		dark += max <= DARK_MAX_VALUE;
+		if (max > DARK_MAX_VALUE && delta * 255 >= PEN_MIN_SATURATION * max) {
+			int hue;
+			if (max == r)
+				hue = (60 * (g - b) / delta + 360) % 360;
+			else if (max == g)
+				hue = 60 * (b - r) / delta + 120;
+			else
+				hue = 60 * (r - g) / delta + 240;
+			pen += hue >= PEN_MIN_HUE && hue <= PEN_MAX_HUE;
+		}
+	}
+	quality.pen_fraction = static_cast<double>(pen) / count;
+	quality.dark_fraction = static_cast<double>(dark) / count;
+	return quality;
+}
+
+} // namespace algorithm
+} // namespace sedeen
@@ -0,0 +1,53 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#ifndef SEDEEN_SRC_TILEEXTRACTION_TILEQUALITY_H
+#define SEDEEN_SRC_TILEEXTRACTION_TILEQUALITY_H
+
+// System headers
+#include <cstdint>
+
+namespace sedeen {
+namespace algorithm {
+
+/// Quality measures of a tile, computed on a coarse version of it
+struct TileQuality {
+  /// Variance of the Laplacian of the grey levels; low values indicate blur
+  double sharpness;
+
+  /// Fraction of pixels with the hue and saturation of marker pen ink
+  double pen_fraction;
+
+  /// Fraction of very dark pixels, typical of tissue folds
+  double dark_fraction;
+};
+
+/// Computes the quality measures of \a width x \a height interleaved RGB pixels
+TileQuality measureTileQuality(const uint8_t* rgb, int width, int height);
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif
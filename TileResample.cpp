@@ -0,0 +1,151 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#include "TileResample.h"
+
+// System headers
+#include <algorithm>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+const int CHANNELS = 3;
+
+/// Halves both dimensions by averaging each 2x2 block
+void halveRgb(const std::vector<uint8_t>& src, int width, int height,
+              std::vector<uint8_t>& dst) {
+	int half_width = width / 2, half_height = height / 2;
+	dst.resize(static_cast<size_t>(half_width) * half_height * CHANNELS);
+	const size_t stride = static_cast<size_t>(width) * CHANNELS;
+	for (int y = 0; y < half_height; ++y) {
+		const uint8_t* top = src.data() + 2 * y * stride;
+		const uint8_t* bottom = top + stride;
+		uint8_t* out = dst.data() + static_cast<size_t>(y) * half_width * CHANNELS;
+		for (int x = 0; x < half_width * CHANNELS; ++x) {
+			int i = (x / CHANNELS) * 2 * CHANNELS + x % CHANNELS;
+			out[x] = static_cast<uint8_t>(
+				(top[i] + top[i + CHANNELS] + bottom[i] + bottom[i + CHANNELS] + 2) >> 2);
+		}
+	}
+}
+
+/// Source span and weights of each destination sample along one axis
+struct AreaTaps {
+	std::vector<int> first;
+	std::vector<int> count;
+	std::vector<float> weights;
+	std::vector<size_t> offset;
+};
+
+AreaTaps areaTaps(int src_size, int dst_size) {
+	AreaTaps taps;
+	double ratio = static_cast<double>(src_size) / dst_size;
+	for (int d = 0; d < dst_size; ++d) {
+		double start = d * ratio, end = (d + 1) * ratio;
+		int first = static_cast<int>(start);
+		int last = std::min(src_size - 1, static_cast<int>(end - 1e-9));
+		taps.first.push_back(first);
+		taps.count.push_back(last - first + 1);
+		taps.offset.push_back(taps.weights.size());
+		for (int s = first; s <= last; ++s) {
+			double covered = std::min<double>(s + 1, end) - std::max<double>(s, start);
+			taps.weights.push_back(static_cast<float>(covered / ratio));
+		}
+	}
+	return taps;
+}
+
+std::vector<uint8_t> areaResizeRgb(const uint8_t* src, int src_width, int src_height,
+                                   int dst_width, int dst_height) {
+	auto columns = areaTaps(src_width, dst_width);
+	auto rows = areaTaps(src_height, dst_height);
+
+	// Horizontal pass into floats, then vertical pass into bytes
+	std::vector<float> horizontal(static_cast<size_t>(dst_width) * src_height * CHANNELS);
+	for (int y = 0; y < src_height; ++y) {
+		const uint8_t* in = src + static_cast<size_t>(y) * src_width * CHANNELS;
+		float* out = horizontal.data() + static_cast<size_t>(y) * dst_width * CHANNELS;
+		for (int x = 0; x < dst_width; ++x) {
+			const float* w = columns.weights.data() + columns.offset[x];
+			const uint8_t* p = in + columns.first[x] * CHANNELS;
+			float r = 0.f, g = 0.f, b = 0.f;
+			for (int k = 0; k < columns.count[x]; ++k) {
+				r += w[k] * p[k * CHANNELS];
+				g += w[k] * p[k * CHANNELS + 1];
+				b += w[k] * p[k * CHANNELS + 2];
+			}
+			out[x * CHANNELS] = r;
+			out[x * CHANNELS + 1] = g;
+			out[x * CHANNELS + 2] = b;
+		}
+	}
+
+	const size_t row_size = static_cast<size_t>(dst_width) * CHANNELS;
+	std::vector<float> accumulator(row_size);
+	std::vector<uint8_t> dst(row_size * dst_height);
+	for (int y = 0; y < dst_height; ++y) {
+		std::fill(accumulator.begin(), accumulator.end(), 0.f);
+		const float* w = rows.weights.data() + rows.offset[y];
+		for (int k = 0; k < rows.count[y]; ++k) {
+			const float* in = horizontal.data() + (rows.first[y] + k) * row_size;
+			for (size_t i = 0; i < row_size; ++i)
+				accumulator[i] += w[k] * in[i];
+		}
+		uint8_t* out = dst.data() + y * row_size;
+		for (size_t i = 0; i < row_size; ++i)
+			out[i] = static_cast<uint8_t>(std::min(255.f, accumulator[i] + 0.5f));
+	}
+	return dst;
+}
+
+} // namespace
+
+std::vector<uint8_t> reduceRgb(const uint8_t* src, int src_width, int src_height,
+                               int dst_width, int dst_height) {
+	dst_width = std::max(1, std::min(dst_width, src_width));
+	dst_height = std::max(1, std::min(dst_height, src_height));
+
+	std::vector<uint8_t> current(src, src + static_cast<size_t>(src_width) * src_height * CHANNELS);
+	std::vector<uint8_t> next;
+	int width = src_width, height = src_height;
+
+	// Exact halvings first, they need no weights
+	while (width >= 2 * dst_width && height >= 2 * dst_height &&
+		   0 == width % 2 && 0 == height % 2) {
+		halveRgb(current, width, height, next);
+		current.swap(next);
+		width /= 2;
+		height /= 2;
+	}
+
+	if (width == dst_width && height == dst_height)
+		return current;
+	return areaResizeRgb(current.data(), width, height, dst_width, dst_height);
+}
+
+} // namespace algorithm
+} // namespace sedeen
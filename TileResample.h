@@ -0,0 +1,52 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#ifndef SEDEEN_SRC_TILEEXTRACTION_TILERESAMPLE_H
+#define SEDEEN_SRC_TILEEXTRACTION_TILERESAMPLE_H
+
+// System headers
+#include <cstdint>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+/// Reduces interleaved RGB pixels to \a dst_width x \a dst_height
+//
+/// Ratios that are powers of two are handled by repeated 2x2 box averages in
+/// integer arithmetic; other ratios use a separable area filter in which each
+/// destination pixel averages the source pixels it covers, weighted by the
+/// covered fraction. Enlarging is not supported: destination dimensions are
+/// clamped to the source dimensions.
+//
+/// \return
+/// The reduced pixels, row-major
+std::vector<uint8_t> reduceRgb(const uint8_t* src, int src_width, int src_height,
+                               int dst_width, int dst_height);
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif
@@ -0,0 +1,283 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#include "TileScheduler.h"
+
+// System headers
+#include <algorithm>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+// Memory, in bytes, all slides together may hold in tile buffers
+const uint64_t MEMORY_BUDGET = 2ull << 30;
+
+// Slide reads and tile writes that may be in flight across all slides
+const int MAX_CONCURRENT_IO = 8;
+
+} // namespace
+
+TileScheduler::TaskGroup::TaskGroup(bool releases_memory)
+    : tasks_(),
+      releases_memory_(releases_memory),
+      pending_(0),
+      error_() {
+}
+
+TileScheduler::MemoryReservation::MemoryReservation(TileScheduler& scheduler,
+                                                    uint64_t bytes)
+    : scheduler_(scheduler),
+      bytes_(bytes) {
+	auto fits = [&]() {
+		return 0 == scheduler_.memory_used_ ||
+			scheduler_.memory_used_ + bytes_ <= scheduler_.memory_budget_;
+	};
+
+	std::unique_lock<std::mutex> lock(scheduler_.resource_mutex_);
+	for (;;) {
+		scheduler_.resource_released_.wait(lock, [&]() {
+			return fits() || scheduler_.releasing_tasks_ > 0;
+		});
+		if (fits())
+			break;
+
+		// The memory is held by queued writes; run one instead of waiting
+		lock.unlock();
+		scheduler_.runReleasingTask();
+		lock.lock();
+	}
+	scheduler_.memory_used_ += bytes_;
+}
+
+TileScheduler::MemoryReservation::~MemoryReservation() {
+	std::lock_guard<std::mutex> lock(scheduler_.resource_mutex_);
+	scheduler_.memory_used_ -= bytes_;
+	scheduler_.resource_released_.notify_all();
+}
+
+TileScheduler::IoSlot::IoSlot(TileScheduler& scheduler)
+    : scheduler_(scheduler) {
+	std::unique_lock<std::mutex> lock(scheduler_.resource_mutex_);
+	scheduler_.resource_released_.wait(lock, [&]() {
+		return scheduler_.io_used_ < scheduler_.io_limit_;
+	});
+	++scheduler_.io_used_;
+}
+
+TileScheduler::IoSlot::~IoSlot() {
+	std::lock_guard<std::mutex> lock(scheduler_.resource_mutex_);
+	--scheduler_.io_used_;
+	scheduler_.resource_released_.notify_all();
+}
+
+std::shared_ptr<TileScheduler> TileScheduler::shared() {
+	static std::mutex shared_mutex;
+	static std::weak_ptr<TileScheduler> shared_scheduler;
+
+	std::lock_guard<std::mutex> lock(shared_mutex);
+	auto scheduler = shared_scheduler.lock();
+	if (nullptr == scheduler) {
+		auto num_threads = std::max(1u, std::thread::hardware_concurrency());
+		scheduler.reset(new TileScheduler(num_threads, MEMORY_BUDGET, MAX_CONCURRENT_IO));
+		shared_scheduler = scheduler;
+	}
+	return scheduler;
+}
+
+TileScheduler::TileScheduler(unsigned num_threads, uint64_t memory_budget,
+                             int io_limit)
+    : next_group_(0),
+      stopping_(false),
+      memory_budget_(memory_budget),
+      memory_used_(0),
+      io_limit_(io_limit),
+      io_used_(0),
+      releasing_tasks_(0) {
+	for (unsigned i = 0; i < num_threads; ++i)
+		workers_.emplace_back(&TileScheduler::workerLoop, this);
+}
+
+TileScheduler::~TileScheduler() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	work_available_.notify_all();
+	for (auto& worker : workers_)
+		worker.join();
+}
+
+void TileScheduler::submit(TaskGroup& group, const std::function<void()>& task) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (group.tasks_.empty())
+			groups_.push_back(&group);
+		group.tasks_.push_back(task);
+		++group.pending_;
+	}
+	work_available_.notify_one();
+
+	if (group.releases_memory_) {
+		std::lock_guard<std::mutex> lock(resource_mutex_);
+		++releasing_tasks_;
+		resource_released_.notify_all();
+	}
+}
+
+void TileScheduler::wait(TaskGroup& group) {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (group.pending_ > 0) {
+		// Help with the group's own tasks rather than block a core
+		TaskGroup* owner = nullptr;
+		std::function<void()> task;
+		if (takeTask(&group, owner, task)) {
+			lock.unlock();
+			runTask(group, task);
+			lock.lock();
+		} else {
+			task_finished_.wait(lock);
+		}
+	}
+
+	auto error = group.error_;
+	group.error_ = nullptr;
+	lock.unlock();
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void TileScheduler::throttle(TaskGroup& group, size_t max_pending) {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (group.pending_ > max_pending && !group.error_) {
+		TaskGroup* owner = nullptr;
+		std::function<void()> task;
+		if (takeTask(&group, owner, task)) {
+			lock.unlock();
+			runTask(group, task);
+			lock.lock();
+		} else {
+			task_finished_.wait(lock);
+		}
+	}
+
+	auto error = group.error_;
+	lock.unlock();
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void TileScheduler::workerLoop() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (;;) {
+		work_available_.wait(lock, [&]() { return stopping_ || !groups_.empty(); });
+		if (stopping_)
+			return;
+
+		TaskGroup* group = nullptr;
+		std::function<void()> task;
+		if (takeTask(nullptr, group, task)) {
+			lock.unlock();
+			runTask(*group, task);
+			lock.lock();
+		}
+	}
+}
+
+bool TileScheduler::takeTask(TaskGroup* only, TaskGroup*& group,
+                             std::function<void()>& task) {
+	size_t index;
+	if (only) {
+		if (only->tasks_.empty())
+			return false;
+		index = std::find(groups_.begin(), groups_.end(), only) - groups_.begin();
+	} else {
+		if (groups_.empty())
+			return false;
+		index = next_group_ % groups_.size();
+	}
+
+	group = groups_[index];
+	task = group->tasks_.front();
+	group->tasks_.pop_front();
+	if (group->releases_memory_)
+		--releasing_tasks_;
+
+	// Groups stay in the rotation only while they have queued tasks
+	if (group->tasks_.empty()) {
+		groups_.erase(groups_.begin() + index);
+		if (index < next_group_)
+			--next_group_;
+	} else if (!only) {
+		++next_group_;
+	}
+	if (!groups_.empty())
+		next_group_ %= groups_.size();
+	return true;
+}
+
+bool TileScheduler::runReleasingTask() {
+	TaskGroup* group = nullptr;
+	std::function<void()> task;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto releasing = std::find_if(groups_.begin(), groups_.end(),
+			[](const TaskGroup* g) { return g->releases_memory_; });
+		if (releasing == groups_.end() || !takeTask(*releasing, group, task))
+			return false;
+	}
+	runTask(*group, task);
+	return true;
+}
+
+void TileScheduler::runTask(TaskGroup& group, const std::function<void()>& task) {
+	std::exception_ptr error;
+	bool failed;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		failed = nullptr != group.error_;
+	}
+
+	// Once a task of the group failed, the remaining ones are only drained
+	if (!failed) {
+		try {
+			task();
+		} catch (...) {
+			error = std::current_exception();
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (error && !group.error_)
+			group.error_ = error;
+		--group.pending_;
+	}
+	task_finished_.notify_all();
+}
+
+} // namespace algorithm
+} // namespace sedeen
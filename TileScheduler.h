@@ -0,0 +1,184 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#ifndef SEDEEN_SRC_TILEEXTRACTION_TILESCHEDULER_H
+#define SEDEEN_SRC_TILEEXTRACTION_TILESCHEDULER_H
+
+// System headers
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+/// Thread pool shared by every slide processed in the process
+//
+/// Each slide (each TileExtraction instance) submits its work as a TaskGroup
+/// of small units, e.g. chunks of tiles. Idle workers take the next unit from
+/// the groups in round-robin order, so a small slide's units run between
+/// those of a large slide instead of queueing behind it, and no core stays
+/// idle while any slide has work left. A global memory budget and a limit on
+/// concurrent slide/disk accesses apply across all the slides.
+class TileScheduler {
+ public:
+  /// A set of tasks submitted together and waited on together
+  class TaskGroup {
+   public:
+    /// \param releases_memory
+    /// Whether the tasks only release memory reservations and never reserve
+    /// any, e.g. tile writes. Threads waiting for memory run such tasks
+    /// instead of blocking, so a full budget cannot stall every worker.
+    explicit TaskGroup(bool releases_memory = false);
+
+   private:
+    friend class TileScheduler;
+    std::deque<std::function<void()>> tasks_;
+    bool releases_memory_;
+
+    /// Tasks queued or running
+    size_t pending_;
+
+    /// First exception thrown by a task of the group
+    std::exception_ptr error_;
+  };
+
+  /// Blocks until \a bytes fit in the memory budget and holds them until
+  /// destroyed
+  //
+  /// A reservation larger than the whole budget is granted once no other
+  /// memory is reserved. While waiting, the thread runs queued tasks of
+  /// groups that release memory.
+  class MemoryReservation {
+   public:
+    MemoryReservation(TileScheduler& scheduler, uint64_t bytes);
+    ~MemoryReservation();
+
+   private:
+    MemoryReservation(const MemoryReservation&);
+    MemoryReservation& operator=(const MemoryReservation&);
+
+    TileScheduler& scheduler_;
+    uint64_t bytes_;
+  };
+
+  /// Blocks until fewer than the maximum number of slide or disk accesses
+  /// are in flight and holds an access slot until destroyed
+  class IoSlot {
+   public:
+    explicit IoSlot(TileScheduler& scheduler);
+    ~IoSlot();
+
+   private:
+    IoSlot(const IoSlot&);
+    IoSlot& operator=(const IoSlot&);
+
+    TileScheduler& scheduler_;
+  };
+
+  /// The scheduler shared by all current users
+  //
+  /// The pool is created on first use and stopped when the last reference
+  /// is released.
+  static std::shared_ptr<TileScheduler> shared();
+
+  /// Stops and joins the workers; queued tasks are discarded
+  ~TileScheduler();
+
+  /// Queues \a task in \a group
+  void submit(TaskGroup& group, const std::function<void()>& task);
+
+  /// Runs tasks of \a group on the calling thread until all of them finished
+  //
+  /// \throws
+  /// The first exception thrown by a task of the group
+  void wait(TaskGroup& group);
+
+  /// Runs tasks of \a group on the calling thread until at most
+  /// \a max_pending of them are queued or running
+  //
+  /// \throws
+  /// The first exception thrown by a task of the group; it is rethrown by
+  /// wait() as well
+  void throttle(TaskGroup& group, size_t max_pending);
+
+  /// Number of tiles that can be read or written at the same time
+  int concurrency() const {
+    return std::min(static_cast<int>(workers_.size()), io_limit_);
+  }
+
+ private:
+  TileScheduler(unsigned num_threads, uint64_t memory_budget, int io_limit);
+  TileScheduler(const TileScheduler&);
+  TileScheduler& operator=(const TileScheduler&);
+
+  void workerLoop();
+
+  /// Removes the next task, from \a only or from any group in round-robin
+  /// order; requires \c mutex_ to be held
+  bool takeTask(TaskGroup* only, TaskGroup*& group, std::function<void()>& task);
+
+  /// Runs \a task and marks it finished in \a group
+  void runTask(TaskGroup& group, const std::function<void()>& task);
+
+  /// Runs one queued task of a group that releases memory
+  //
+  /// \return false if there was none
+  bool runReleasingTask();
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable task_finished_;
+
+  /// Groups with queued tasks
+  std::vector<TaskGroup*> groups_;
+  size_t next_group_;
+  bool stopping_;
+  std::vector<std::thread> workers_;
+
+  std::mutex resource_mutex_;
+  std::condition_variable resource_released_;
+  uint64_t memory_budget_;
+  uint64_t memory_used_;
+  int io_limit_;
+  int io_used_;
+
+  /// Queued tasks of groups that release memory; briefly negative while a
+  /// task is taken before its submission is counted
+  std::atomic<int64_t> releasing_tasks_;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif
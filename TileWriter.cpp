@@ -0,0 +1,120 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+
+#include "TileWriter.h"
+
+// System headers
+#include <Windows.h>
+#include <stdexcept>
+
+namespace sedeen {
+namespace algorithm {
+
+namespace {
+
+// Tiles queued or being written before write() starts writing them itself
+const size_t MAX_QUEUED_TILES = 64;
+
+// Files flushed together in SYNC_PER_BATCH mode
+const size_t SYNC_BATCH_SIZE = 256;
+
+} // namespace
+
+TileWriter::TileWriter(TileScheduler& scheduler, Durability durability)
+    : scheduler_(scheduler),
+      durability_(durability),
+      writes_(true),
+      batch_mutex_(),
+      batch_() {
+}
+
+TileWriter::~TileWriter() {
+	try {
+		scheduler_.wait(writes_);
+	}
+	catch (...) {
+	}
+}
+
+void TileWriter::write(const image::RawImage& image, const std::string& path,
+                       const std::shared_ptr<TileScheduler::MemoryReservation>& memory) {
+	scheduler_.throttle(writes_, MAX_QUEUED_TILES);
+
+	auto reservation = memory;
+	scheduler_.submit(writes_, [this, image, path, reservation]() mutable {
+		save(image, path);
+		reservation.reset();
+	});
+}
+
+void TileWriter::finish() {
+	scheduler_.wait(writes_);
+
+	std::vector<std::string> batch;
+	{
+		std::lock_guard<std::mutex> lock(batch_mutex_);
+		batch.swap(batch_);
+	}
+	sync(batch);
+}
+
+void TileWriter::save(const image::RawImage& image, const std::string& path) {
+	{
+		TileScheduler::IoSlot io(scheduler_);
+		if (!image.save(path))
+			throw std::runtime_error("Unable to save the tile: " + path);
+	}
+
+	std::vector<std::string> batch;
+	if (SYNC_PER_FILE == durability_)
+	{
+		batch.push_back(path);
+	}
+	else if (SYNC_PER_BATCH == durability_)
+	{
+		std::lock_guard<std::mutex> lock(batch_mutex_);
+		batch_.push_back(path);
+		if (batch_.size() >= SYNC_BATCH_SIZE)
+			batch.swap(batch_);
+	}
+	sync(batch);
+}
+
+void TileWriter::sync(const std::vector<std::string>& paths) {
+	for (const auto& path : paths) {
+		TileScheduler::IoSlot io(scheduler_);
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (INVALID_HANDLE_VALUE == file)
+			throw std::runtime_error("Unable to flush the tile: " + path);
+		BOOL flushed = FlushFileBuffers(file);
+		CloseHandle(file);
+		if (!flushed)
+			throw std::runtime_error("Unable to flush the tile: " + path);
+	}
+}
+
+} // namespace algorithm
+} // namespace sedeen
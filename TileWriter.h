@@ -0,0 +1,106 @@
+/*=============================================================================
+ *
+ *  Copyright (c) 2019 Sunnybrook Research Institute
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in all
+ *  copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ *  SOFTWARE.
+ *
+ *=============================================================================*/
+
+#ifndef SEDEEN_SRC_TILEEXTRACTION_TILEWRITER_H
+#define SEDEEN_SRC_TILEEXTRACTION_TILEWRITER_H
+
+// DPTK headers
+#include "Image.h"
+
+#include "TileScheduler.h"
+
+// System headers
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sedeen {
+namespace algorithm {
+
+/// Saves tiles as tasks of the shared scheduler so that reading and reducing
+/// the next tiles overlaps with encoding and writing the previous ones
+//
+/// Several writes are kept in flight, which hides the per-file latency of
+/// network shares; each one holds an I/O slot of the scheduler. A queued
+/// tile keeps the memory reservation it was read under until it is saved,
+/// so queued tiles count against the shared budget, and write() runs queued
+/// writes itself while too many are pending.
+class TileWriter {
+ public:
+  /// When written tiles are flushed to disk
+  enum Durability {
+    /// Leave flushing to the operating system
+    NO_SYNC = 0,
+
+    /// Flush the files of each batch together
+    SYNC_PER_BATCH,
+
+    /// Flush every file right after it is written
+    SYNC_PER_FILE
+  };
+
+  TileWriter(TileScheduler& scheduler, Durability durability);
+
+  /// Waits for the queued tiles; errors are discarded, call finish() to
+  /// receive them
+  ~TileWriter();
+
+  /// Queues \a image to be saved as \a path
+  //
+  /// \param memory
+  /// Reservation covering \a image, released once the tile is saved
+  /// \throws
+  /// The first error of an earlier write, so that the caller stops early
+  void write(const image::RawImage& image, const std::string& path,
+             const std::shared_ptr<TileScheduler::MemoryReservation>& memory);
+
+  /// Waits until every queued tile is saved and flushed as requested
+  //
+  /// \throws std::runtime_error if a tile could not be saved
+  void finish();
+
+ private:
+  TileWriter(const TileWriter&);
+  TileWriter& operator=(const TileWriter&);
+
+  /// Saves \a image as \a path and flushes it as requested
+  void save(const image::RawImage& image, const std::string& path);
+
+  /// Flushes the files of \a paths to disk
+  void sync(const std::vector<std::string>& paths);
+
+  TileScheduler& scheduler_;
+  Durability durability_;
+  TileScheduler::TaskGroup writes_;
+
+  /// Written files not yet flushed, in SYNC_PER_BATCH mode
+  std::mutex batch_mutex_;
+  std::vector<std::string> batch_;
+};
+
+} // namespace algorithm
+} // namespace sedeen
+
+#endif